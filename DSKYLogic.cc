@@ -7,14 +7,49 @@
 #include <iostream>
 #include <string.h>
 #include <sstream>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "DSKYLogic.h"
 
 using namespace std;
 
+dskyWatchers::dskyWatchers(){
+	for(int i=0; i<DSKY_WATCHERS; i++){
+		fds[i].store(-1, memory_order_relaxed);
+	}
+}
+
+dskyWatchers::dskyWatchers(const dskyWatchers&){
+	for(int i=0; i<DSKY_WATCHERS; i++){
+		fds[i].store(-1, memory_order_relaxed);
+	}
+}
+
+bool dskyWatchers::add(int fd){
+	for(int i=0; i<DSKY_WATCHERS; i++){
+		int empty = -1;
+		if(fds[i].compare_exchange_strong(empty, fd))
+			return true;
+	}
+	return false;
+}
+
+void dskyWatchers::notify(){
+	uint64_t one = 1;
+	for(int i=0; i<DSKY_WATCHERS; i++){
+		int fd = fds[i].load(memory_order_acquire);
+		if(fd >= 0 && write(fd, &one, sizeof(one)) < 0)
+			;//the counter is full: the watcher is woken anyway
+	}
+}
+
 DSKYLogic::DSKYLogic(){
 	blinker = true;
-	blinkerCounter = 0;
+	verbBlinker = false;
+	nounBlinker = false;
+	blinkerMCT = 0;
+	strobeMCT = 0;
 	strobeCounter = 0;
 	
 	for(int i=0; i<18; i++){
@@ -27,6 +62,9 @@ DSKYLogic::DSKYLogic(){
 	digits[6] = ' ';
 	digits[12] = ' ';
 	digits[18] = ' ';
+	
+	memset(&shown, 0xFF, sizeof(shown));	//nothing shown yet: the first frame is always new
+	publish();
 }
 
 char DSKYLogic::bitmapToDigit(uint8_t input){
@@ -57,97 +95,111 @@ char DSKYLogic::bitmapToDigit(uint8_t input){
 		return 'e';//Error (Does not exist on real AGC)
 }
 
-void DSKYLogic::clearStrobes(){
+void DSKYLogic::clearStrobes(long unsigned mct){
+	if(mct < strobeMCT)//the AGC was rebooted
+		strobeMCT = mct;
 	if(lamps[14] == true){
-		strobeCounter++;
+		strobeCounter += mct - strobeMCT;
 		if(strobeCounter > STROBE_PERIOD){
 			lamps[14] = false;
 			strobeCounter = 0;
+			publish();
 		}
 	}
+	strobeMCT = mct;
 }
 
-string DSKYLogic::getStatus(){
-	char subbuff[7];
-	
-	memcpy(subbuff, &digits[0], 2);
-	subbuff[2] = '\0';
-	string reg0(subbuff);
+void DSKYLogic::publish(){
+	dskyFrame frame;
+	memset(&frame, 0, sizeof(frame));
 	
-	if(!verbBlinker || blinker){
-		memcpy(subbuff, &digits[2], 2);
-		subbuff[2] = '\0';
-	}
-	else{
-		subbuff[0] = ' ';
-		subbuff[1] = ' ';
-		subbuff[2] = '\0';
+	for(int i=0; i<18; i++){
+		frame.lamps[i] = lamps[i];
 	}
-	string reg1(subbuff);
+	frame.lamps[3] = lamps[3] & blinker;
+	frame.lamps[4] = lamps[4] & blinker;
 	
-	if(!nounBlinker || blinker){
-		memcpy(subbuff, &digits[4], 2);
-		subbuff[2] = '\0';
+	memcpy(frame.digits, digits, 24);
+	if(verbBlinker && !blinker){
+		frame.digits[2] = ' ';
+		frame.digits[3] = ' ';
 	}
-	else{
-		subbuff[0] = ' ';
-		subbuff[1] = ' ';
-		subbuff[2] = '\0';
+	if(nounBlinker && !blinker){
+		frame.digits[4] = ' ';
+		frame.digits[5] = ' ';
 	}
-	string reg2(subbuff);
-	
-	memcpy(subbuff, &digits[6], 6);
-	subbuff[6] = '\0';
-	string reg3(subbuff);
-	
-	memcpy(subbuff, &digits[12], 6);
-	subbuff[6] = '\0';
-	string reg4(subbuff);
-	
-	memcpy(subbuff, &digits[18], 6);
-	subbuff[6] = '\0';
-	string reg5(subbuff);
-	
 	
+	//Readers poll the version: a frame equal to the last one is not a new one
+	if(memcmp(&frame, &shown, sizeof(frame)) == 0)
+		return;
+	shown = frame;
+	published.publish(frame);
+	watchers.notify();
+}
+
+int DSKYLogic::watch(){
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(fd >= 0 && !watchers.add(fd)){
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+void DSKYLogic::wake(){
+	watchers.notify();
+}
+
+
+uint64_t DSKYLogic::getFrame(dskyFrame &frame){
+	uint64_t version;
+	frame = published.read(version);
+	return version;
+}
+
+string DSKYLogic::getStatus(){
+	dskyFrame frame;
+	getFrame(frame);
+	return format(frame);
+}
+
+string DSKYLogic::format(const dskyFrame &frame, const dskyFrame *last){
+	static const int registers[7] = {0, 2, 4, 6, 12, 18, 24};//first digit of each register
+	const char *separator = "";
 	stringstream buffer;
 	
-	buffer << "{\x22success\x22:true,\x22lamps\x22:["
-	<< "{\x22id\x22:\x22lamp_1\x22,\x22value\x22:" << lamps[0] << "},"
-	<< "{\x22id\x22:\x22lamp_2\x22,\x22value\x22:" << lamps[1] << "},"
-	<< "{\x22id\x22:\x22lamp_3\x22,\x22value\x22:" << lamps[2] << "},"
-	<< "{\x22id\x22:\x22lamp_4\x22,\x22value\x22:" << (lamps[3] & blinker) << "},"
-	<< "{\x22id\x22:\x22lamp_5\x22,\x22value\x22:" << (lamps[4] & blinker) << "},"
-	<< "{\x22id\x22:\x22lamp_6\x22,\x22value\x22:" << lamps[5] << "},"
-	<< "{\x22id\x22:\x22lamp_7\x22,\x22value\x22:" << lamps[6] << "},"
-	<< "{\x22id\x22:\x22lamp_8\x22,\x22value\x22:" << lamps[7] << "},"
-	<< "{\x22id\x22:\x22lamp_9\x22,\x22value\x22:" << lamps[8] << "},"
-	<< "{\x22id\x22:\x22lamp_10\x22,\x22value\x22:" << lamps[9] << "},"
-	<< "{\x22id\x22:\x22lamp_11\x22,\x22value\x22:" << lamps[10] << "},"
-	<< "{\x22id\x22:\x22lamp_12\x22,\x22value\x22:" << lamps[11] << "},"
-	<< "{\x22id\x22:\x22lamp_13\x22,\x22value\x22:" << lamps[12] << "},"
-	<< "{\x22id\x22:\x22lamp_14\x22,\x22value\x22:" << lamps[13] << "},"
-	<< "{\x22id\x22:\"disp_lamp_1\x22,\x22value\x22:" << lamps[14] << "},"
-	<< "{\x22id\x22:\"disp_lamp_2\x22,\x22value\x22:" << lamps[15] << "},"
-	<< "{\x22id\x22:\"disp_lamp_3\x22,\x22value\x22:" << lamps[16] << "},"
-	<< "{\x22id\x22:\"disp_lamp_4\x22,\x22value\x22:" << lamps[17] << "}"
-	<< "],\"digits\x22:["
-	<< "{\x22id\x22:\"digits_1\x22,\x22value\x22:\"" << reg0 << "\"},"
-	<< "{\x22id\x22:\"digits_2\x22,\x22value\x22:\"" << reg1 << "\"},"
-	<< "{\x22id\x22:\"digits_3\x22,\x22value\x22:\"" << reg2 << "\"},"
-	<< "{\x22id\x22:\"digits_4\x22,\x22value\x22:\"" << reg3 << "\"},"
-	<< "{\x22id\x22:\"digits_5\x22,\x22value\x22:\"" << reg4 << "\"},"
-	<< "{\x22id\x22:\"digits_6\x22,\x22value\x22:\"" << reg5 << "\"}"
-	<< "]}";
+	buffer << "{\"success\":true,\"lamps\":[";
+	for(int i=0; i<18; i++){
+		if(last && last->lamps[i] == frame.lamps[i])
+			continue;
+		buffer << separator << "{\"id\":\"" << (i < 14 ? "lamp_" : "disp_lamp_") << (i < 14 ? i + 1 : i - 13)
+		<< "\",\"value\":" << (int)frame.lamps[i] << "}";
+		separator = ",";
+	}
+	
+	buffer << "],\"digits\":[";
+	separator = "";
+	for(int i=0; i<6; i++){
+		int length = registers[i + 1] - registers[i];
+		if(last && memcmp(&last->digits[registers[i]], &frame.digits[registers[i]], length) == 0)
+			continue;
+		buffer << separator << "{\"id\":\"digits_" << (i + 1) << "\",\"value\":\"" << string(&frame.digits[registers[i]], length) << "\"}";
+		separator = ",";
+	}
+	buffer << "]}";
 	
 	string responseBody = buffer.str();
 	return responseBody;
 }
 
-void DSKYLogic::toggleBlinker(){
-	blinkerCounter++;
-	if(blinkerCounter > BLINKER_PERIOD){
+void DSKYLogic::toggleBlinker(long unsigned mct){
+	if(mct < blinkerMCT)//the AGC was rebooted
+		blinkerMCT = mct;
+	if(mct - blinkerMCT > BLINKER_PERIOD){
 		blinker = !blinker;
-		blinkerCounter = 0;
+		blinkerMCT = mct;
+		if(lamps[3] || lamps[4] || verbBlinker || nounBlinker)
+			publish();
 	}
 }
 
@@ -266,6 +318,7 @@ void DSKYLogic::write8(uint16_t word){
 		else
 			lamps[10] = true;
 			
+		publish();
 		return;
 	}
 	else{
@@ -308,6 +361,8 @@ void DSKYLogic::write8(uint16_t word){
 	else{
 		digits[18] = ' ';
 	}
+	
+	publish();
 }
 
 void DSKYLogic::write9(uint16_t word){
@@ -353,6 +408,8 @@ void DSKYLogic::write9(uint16_t word){
 		lamps[16] = false;
 	else
 		lamps[16] = true;
+	
+	publish();
 }
 
 void DSKYLogic::write40(uint16_t word){
@@ -365,4 +422,34 @@ void DSKYLogic::write40(uint16_t word){
 		verbBlinker = false;
 	else
 		verbBlinker = true;
+	
+	publish();
+}
+
+void DSKYLogic::save(dskySnapshot &snapshot){
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.blinker = blinker;
+	snapshot.verbBlinker = verbBlinker;
+	snapshot.nounBlinker = nounBlinker;
+	for(int i=0; i<18; i++){
+		snapshot.lamps[i] = lamps[i];
+	}
+	memcpy(snapshot.digits, digits, sizeof(digits));
+	snapshot.blinkerMCT = blinkerMCT;
+	snapshot.strobeMCT = strobeMCT;
+	snapshot.strobeCounter = strobeCounter;
+}
+
+void DSKYLogic::load(const dskySnapshot &snapshot){
+	blinker = snapshot.blinker;
+	verbBlinker = snapshot.verbBlinker;
+	nounBlinker = snapshot.nounBlinker;
+	for(int i=0; i<18; i++){
+		lamps[i] = snapshot.lamps[i];
+	}
+	memcpy(digits, snapshot.digits, sizeof(digits));
+	blinkerMCT = snapshot.blinkerMCT;
+	strobeMCT = snapshot.strobeMCT;
+	strobeCounter = snapshot.strobeCounter;
+	publish();
 }
@@ -7,11 +7,51 @@
 #pragma once
 
 #include <string.h>
+#include <cstdint>
+#include <string>
+#include <atomic>
+
+#include "seqlock.h"
 
 using namespace std;
 
-#define BLINKER_PERIOD 16666
-#define STROBE_PERIOD 8333
+#define BLINKER_PERIOD (280000 / 12)	// 280 ms of MCT
+#define STROBE_PERIOD (140000 / 12)		// 140 ms of MCT
+#define DSKY_WATCHERS 16					// eventfds woken by a new frame
+
+/* DSKYLogic state in a snapshot: fixed size types only */
+struct dskySnapshot {
+	uint8_t blinker;
+	uint8_t verbBlinker;
+	uint8_t nounBlinker;
+	uint8_t lamps[18];
+	char digits[31];
+	uint8_t reserved[3];
+	uint64_t blinkerMCT;
+	uint64_t strobeMCT;
+	uint64_t strobeCounter;
+};
+
+/* what the DSKY shows, blinking applied: published by the CPU for the other threads */
+struct dskyFrame {
+	uint8_t lamps[18];
+	char digits[24];		// the six registers: 2, 2, 2, 6, 6 and 6 characters
+	uint8_t reserved[6];
+};
+
+/* eventfds of the threads waiting for a new frame, kept for the life of the DSKY; a copy starts with none */
+class dskyWatchers
+{
+private:
+	atomic<int> fds[DSKY_WATCHERS];
+
+public:
+	dskyWatchers();
+	dskyWatchers(const dskyWatchers&);
+	dskyWatchers& operator=(const dskyWatchers&){ return *this; }
+	bool add(int fd);
+	void notify();
+};
 
 class DSKYLogic
 {
@@ -19,19 +59,30 @@ private:
 	bool blinker;
 	bool verbBlinker;
 	bool nounBlinker;
-	int blinkerCounter;
-	int strobeCounter;
+	long unsigned blinkerMCT;		// MCT of the last blink
+	long unsigned strobeMCT;		// MCT of the last clearStrobes()
+	long unsigned strobeCounter;	// MCT spent with COMP ACTY on
 	bool lamps [18];
 	char digits [31];//24 + 6 for sign + 1 fake
+	dskyFrame shown;				// last frame published
+	seqlock<dskyFrame> published;	// shown, for the readers
+	dskyWatchers watchers;
 	
 	char bitmapToDigit(uint8_t input);
+	void publish();					/* new version of the frame, if it changed */
 
 public:
 	DSKYLogic();
-	void clearStrobes();
-	string getStatus();
-	void toggleBlinker();
+	void clearStrobes(long unsigned mct);
+	string getStatus();				/* JSON of the last frame published, from any thread */
+	uint64_t getFrame(dskyFrame &frame);	/* the last frame published, from any thread; returns its version */
+	static string format(const dskyFrame &frame, const dskyFrame *last = NULL);	/* JSON of /status; with last, only what changed since */
+	int watch();						/* eventfd readable after every new frame, -1 when DSKY_WATCHERS are taken */
+	void wake();						/* makes the eventfds readable with no new frame */
+	void toggleBlinker(long unsigned mct);
 	void write8(uint16_t word);
 	void write9(uint16_t word);
 	void write40(uint16_t word);
+	void save(dskySnapshot &snapshot);
+	void load(const dskySnapshot &snapshot);
 };
\ No newline at end of file
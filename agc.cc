@@ -6,14 +6,134 @@
 
 #include "agc.h"
 
-agc::agc() {
+agc::agc(const agcOptions &options) {
 		
+	this->options = options;
+	fault = NO_FAULT;
 	DSKYReady = false;
+	requests = 0;
+	queuedInputs = 0;
+	takenInputs = 0;
+	keyMCT = 0;
 	dsky = DSKYLogic();
+	checkpoints = NULL;
+	nextLog = ULONG_MAX;
+	historyDepth = 0;
+	nextHistory = ULONG_MAX;
+	nextReplay = ULONG_MAX;
+	nextEvent = ULONG_MAX;
+	steps = 0;
+	nextInput = ULONG_MAX;
+	watchIndex = -1;
+	watchInterrupt = false;
+	watchHit = false;
+	allocateCaches();
 	boot();
 	
 }
 
+agc::agc(const agc &source) : agc(source, source.options) {
+}
+
+agc::agc(const agc &source, const agcOptions &options) {
+	
+	allocateCaches();
+	copyState(source, options);
+	
+}
+
+void agc::reset(const agc &source){
+	reset(source, source.options);
+}
+
+void agc::reset(const agc &source, const agcOptions &options){
+	
+	// What the last run left: the caches are emptied, their memory kept
+	stopCheckpoints();
+	stopRecording();
+	madvise(decodeCache, 2 * sizeof(*decodeCache), MADV_DONTNEED);//zero pages again
+	clearBlockCache();
+	history.clear();
+	inputs.clear();
+	replay.clear();
+	agcInput input;
+	while(pending.front(input))
+		pending.pop();
+	copyState(source, options);
+	
+}
+
+void agc::setOptions(const agcOptions &options){
+	
+	this->options = options;
+	resetClock();
+	
+}
+
+void agc::copyState(const agc &source, const agcOptions &options){
+	
+	// Erasable and IO are a few KB: copied. ROM is shared until one of the
+	// two writes it, the caches start empty and refill on demand.
+	this->options = options;
+	fault = source.fault;
+	DSKYReady = source.DSKYReady.load();
+	requests = 0;
+	queuedInputs = 0;
+	takenInputs = 0;
+	keyMCT = source.keyMCT;
+	dsky = source.dsky;
+	
+	memcpy(RAM, source.RAM, sizeof(RAM));
+	memcpy(IO, source.IO, sizeof(IO));
+	memoryHash = source.memoryHash;
+	romData = source.romData;
+	ROM = romData->data();
+	mapBanks();
+	memcpy(compiledCode, source.compiledCode, sizeof(compiledCode));
+	
+	OPCODE = source.OPCODE;
+	ADDR = source.ADDR;
+	MASKINTR = source.MASKINTR;
+	INTR = source.INTR;
+	EXT = source.EXT;
+	OW = source.OW;
+	INX = source.INX;
+	INT_TYPE = source.INT_TYPE;
+	SIGN = source.SIGN;
+	S = source.S;
+	B = source.B;
+	MCT = source.MCT;
+	T4INC = source.T4INC;
+	stopMCT = source.stopMCT;
+	stopZ = source.stopZ;
+	stopReason = source.stopReason;
+	resetClock();
+	
+	// The log and the history stay with the source
+	checkpoints = NULL;
+	nextLog = ULONG_MAX;
+	historyDepth = 0;
+	nextHistory = ULONG_MAX;
+	nextReplay = ULONG_MAX;
+	nextEvent = ULONG_MAX;
+	dirtyPages = (1 << CHECKPOINT_PAGES) - 1;
+	steps = source.steps;
+	nextInput = ULONG_MAX;
+	watchIndex = -1;
+	watchInterrupt = false;
+	watchHit = false;
+	
+}
+
+agc::~agc(){
+	
+	stopCheckpoints();
+	stopRecording();
+	munmap(decodeCache, 2 * sizeof(*decodeCache));
+	delete[] blockCache;
+	
+}
+
 void agc::boot(){
 	
 	// Clear memories
@@ -21,13 +141,14 @@ void agc::boot(){
 		RAM[i] = 0;
 	}
 	
-	for(int i=0; i<ROMSIZE; i++){
-		ROM[i] = 0;
-	}
+	romData = make_shared<vector<uint16_t> >(ROMSIZE, 0);//never written in place, clones may share the old one
+	ROM = romData->data();
 	
 	for(int i=0; i<IOSIZE; i++){
 		IO[i] = 0;
 	}
+	mapBanks();
+	dirtyPages = (1 << CHECKPOINT_PAGES) - 1;
 	
 	// Reset flags
 	MASKINTR = false;
@@ -44,12 +165,21 @@ void agc::boot(){
 	loadMAIN();
 	loadPrograms();
 	//prog1();
+	rehash();
+	clearDecodeCache();
+	clearBlockCache();
 	
 	// Basic settings
 	MCT = 0;
 	T4INC = 0;
 	TIME4 = 0xFFFE;
-	time_zero = steady_clock::now();
+	resetClock();
+	stopMCT = ULONG_MAX;
+	stopZ = -1;
+	stopReason = STOP_MCT;
+	nextLog = checkpoints ? MCT : ULONG_MAX;//MCT starts over with a full checkpoint
+	nextHistory = historyDepth ? MCT : ULONG_MAX;
+	nextEvent = min(min(nextLog, nextHistory), nextReplay);
 	Z = (BIOS << 1);
 	
 }
@@ -61,7 +191,7 @@ void agc::rupt(){
 	
 	switch(BRUPT >> 1){
 		case KEY_RSET:
-			if(verbose) cout << "Reboot machine\n";
+			if(options.verbose) cout << "Reboot machine\n";
 			boot();
 			break;
 		default:
@@ -70,9 +200,8 @@ void agc::rupt(){
 	
 }
 
-void agc::exceptions(int e){
-	MASKINTR = true;
-			
+const char* agc::exceptionName(int e){
+	
 	switch(e){
 		
 		case ACCESS_IN_IO_MEMORY:
@@ -80,79 +209,203 @@ void agc::exceptions(int e){
 			 * E' stato effettuato un accesso in memoria di IO, con 
 			 * un indirizzo non valido.
 			 */
-			cout << "\tEXCEPTION: ACCESS_IN_IO_MEMORY";
-			break;
+			return "ACCESS_IN_IO_MEMORY";
 		
 		case ACCESS_IN_ERASABLE_MEMORY:
 			/*	
 			 * E' stato effettuato un accesso in erasable memory (RAM), con 
 			 * un indirizzo non valido.
 			 */
-			cout << "\tEXCEPTION: ACCESS_IN_ERASABLE_MEMORY";
-			break;
+			return "ACCESS_IN_ERASABLE_MEMORY";
 			
 		case ACCESS_IN_FIXED_MEMORY:
 			/*	
 			 * E' stato effettuato un accesso in fixed memory (ROM), con 
 			 * un indirizzo non valido.
 			 */
-			cout << "\tEXCEPTION: ACCESS_IN_FIXED_MEMORY";
-			break;
+			return "ACCESS_IN_FIXED_MEMORY";
 			
 		case NO_DIVISION:
 			/*	
 			 * E' stata eseguita una divisione per zero.
 			 */
-			cout << "\tEXCEPTION: NO_DIVISION";
-			break;
+			return "NO_DIVISION";
 			
 		case NO_INTERRUPT:
 			/*	
 			 * Non è stato individuato il gate di interruzione nella tabella 
 			 * di interruzione.
 			 */
-			cout << "\tEXCEPTION: NO_INTERRUPT";
-			break;
+			return "NO_INTERRUPT";
 			
 		case NO_OPERAND:
 			/*	
 			 * Non è stato decodificato un operando valido. 
 			 */
-			cout << "\tEXCEPTION: NO_OPERAND";
-			break;
+			return "NO_OPERAND";
 			
 		case USED_EDITING_REGISTER:
 			/*	
 			 * E' stata effettuata una operazione non autorizzata su un registro di editing. 
 			 */
-			cout << "\tEXCEPTION: USED_EDITING_REGISTER";
-			break;
+			return "USED_EDITING_REGISTER";
 			
 		case ALT:
 			/*	
 			 * E' stata fermata la macchina.
 			 */
-			cout << "\tEXCEPTION: ALT";
-			break;
+			return "ALT";
 			
 		default:	
 			/*	
 			 * Si è verificata una situazione anomala. Non è stato possibile etichettare
 			 * l'eccezione con una delle precedenti.
 			 */
-			cout << "\tEXCEPTION: UNKNOWN_ERROR";
+			return "UNKNOWN_ERROR";
+	
+	}
+	
+}
+
+void agc::exceptions(int e){
+	
+	// The machine stops: the fault is reported to the caller of emulate()
+	MASKINTR = true;
+	fault = e;
+	
+}
+
+int agc::getFault(){
+	return fault;
+}
+
+int agc::getStopReason(){
+	return stopReason;
+}
+
+bool agc::dskyInput(uint16_t key){
+	return queueInput(INPUT_KEY, key);
+}
+
+bool agc::queueInput(uint16_t kind, uint16_t value){
+	
+	agcInput input;
+	input.kind = kind;
+	input.value = value;
+	input.gap = 0;
+	{
+		lock_guard<mutex> guard(inputLock);
+		if(!pending.push(input))
+			return false;
+		queuedInputs++;
+	}
+	requests.fetch_or(REQUEST_INPUT);
+	return true;
+	
+}
+
+uint64_t agc::queueKeys(const uint16_t *keys, size_t count, uint32_t gap){
+	
+	uint64_t ticket;
+	{
+		lock_guard<mutex> guard(inputLock);
+		if(count == 0 || pending.space() < count)
+			return 0;
+		for(size_t i=0; i<count; i++){
+			agcInput input;
+			input.kind = INPUT_KEY;
+			input.value = keys[i];
+			input.gap = gap;
+			pending.push(input);
+		}
+		queuedInputs += count;
+		ticket = queuedInputs;
+	}
+	requests.fetch_or(REQUEST_INPUT);
+	return ticket;
+	
+}
+
+bool agc::inputTaken(uint64_t ticket){
+	return takenInputs.load(memory_order_acquire) >= ticket;
+}
+
+void agc::takeInput(agcInput &input){
+	
+	input.mct = MCT;
+	input.steps = steps;
+	if(historyDepth)
+		inputs.push_back(input);
+	if(inputRecord.is_open())//inputs are rare: flushed one by one, a crash loses none
+		inputRecord << input.mct << (input.kind == INPUT_KEY ? " key " : " pro ") << input.value << endl;
+	applyInput(input);
 	
+}
+
+void agc::applyInput(const agcInput &input){
+	
+	if(input.kind == INPUT_KEY){
+		IO[12] = (IO[12] & 0b1111111111000001) | (input.value << 1); // Real AGC may not zero the bits before a new input if interrupt # has not been performed
+		INT_TYPE = INT_KEYRUPT;
+		setInterrupt();
 	}
+	else if(input.value)
+		IO[25] = IO[25] | 0b0100000000000000;
+	else
+		IO[25] = IO[25] & 0b1011111111111111;
+	
+}
+
+bool agc::recordInputs(const char *path){
+	
+	stopRecording();
+	inputRecord.open(path, ios::trunc);
+	if(!inputRecord)
+		return false;
+	inputRecord << INPUT_MAGIC << endl;
+	return true;
 	
-	debug();
-	exit(-1);
 }
 
-void agc::dskyInput(uint16_t key){
+void agc::stopRecording(){
 	
-	IO[12] = (IO[12] & 0b1111111111000001) | (key << 1); // Real AGC may not zero the bits before a new input if interrupt # has not been performed
-	INT_TYPE = 20 << 1;
-	setInterrupt();
+	if(inputRecord.is_open()){
+		inputRecord << MCT << " end 0" << endl;
+		inputRecord.close();
+	}
+	
+}
+
+bool agc::replayInputs(const char *path, long unsigned &end){
+	
+	ifstream file(path);
+	string line;
+	if(!getline(file, line) || line != INPUT_MAGIC)
+		return false;
+	
+	deque<agcInput> loaded;
+	end = MCT;
+	agcInput input;
+	input.gap = 0;
+	string kind;
+	while(file >> input.mct >> kind >> input.value){
+		end = input.mct;
+		if(kind == "end")
+			break;
+		if(kind != "key" && kind != "pro")
+			return false;
+		input.kind = (kind == "key") ? INPUT_KEY : INPUT_PRO;
+		if(!loaded.empty() && input.mct < loaded.back().mct)
+			return false;
+		loaded.push_back(input);
+	}
+	if(!file.eof() && kind != "end")
+		return false;
+	
+	replay.swap(loaded);
+	nextReplay = replay.empty() ? ULONG_MAX : replay.front().mct;
+	nextEvent = min(nextEvent, nextReplay);
+	return true;
 	
 }
 
@@ -160,16 +413,44 @@ string agc::getDSKYStatus(){
 	return dsky.getStatus();
 }
 
+uint64_t agc::getDSKYFrame(dskyFrame &frame){
+	return dsky.getFrame(frame);
+}
+
+int agc::watchDSKY(){
+	return dsky.watch();
+}
+
+string agc::getRegisters(){
+	
+	stringstream buffer;
+	
+	// Words in memory format, as debug() prints them in HEX
+	buffer << "{\"OPCODE\":" << OPCODE << ",\"ADDRESS\":" << ADDR
+	<< ",\"MASKINTR\":" << MASKINTR << ",\"INTR\":" << INTR << ",\"EXT\":" << EXT
+	<< ",\"INX\":" << INX << ",\"OW\":" << OW
+	<< ",\"A\":" << A << ",\"L\":" << L << ",\"Q\":" << Q << ",\"Z\":" << Z << ",\"BB\":" << BB
+	<< ",\"ARUPT\":" << ARUPT << ",\"LRUPT\":" << LRUPT << ",\"QRUPT\":" << QRUPT
+	<< ",\"ZRUPT\":" << ZRUPT << ",\"BRUPT\":" << BRUPT << ",\"BBRUPT\":" << BBRUPT << "}";
+	
+	return buffer.str();
+	
+}
+
+long unsigned agc::getMCT(){
+	return MCT;
+}
+
 void agc::run(){
 	DSKYReady = true;
 }
 
-void agc::resetProBit(){
-	IO[25] = IO[25] & 0b1011111111111111;
+bool agc::resetProBit(){
+	return queueInput(INPUT_PRO, 0);
 }
 
-void agc::setProBit(){
-	IO[25] = IO[25] | 0b0100000000000000;
+bool agc::setProBit(){
+	return queueInput(INPUT_PRO, 1);
 }
 
 void agc::setMCT(uint16_t value){
@@ -178,22 +459,97 @@ void agc::setMCT(uint16_t value){
 
 void agc::slow_down(){
 	
-	auto now = steady_clock::now();
-	long us = duration_cast<microseconds>(now - time_zero).count();
-	long delta = MCT * CYCLE_PERIOD - us;
-	if (delta > 1000){
-		usleep(delta);
+	// Host time at which the current MCT is due: sleeping until an absolute
+	// deadline, and not for a delay, keeps errors from adding up quantum after quantum
+	long long ns = (long long) (MCT * CYCLE_PERIOD * 1000.0 / options.speed);
+	struct timespec deadline = time_zero;
+	deadline.tv_sec += ns / 1000000000;
+	deadline.tv_nsec += ns % 1000000000;
+	if(deadline.tv_nsec >= 1000000000){
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long lag = (now.tv_sec - deadline.tv_sec) * 1000000000LL + (now.tv_nsec - deadline.tv_nsec);
+	if(lag > PACING_MAX_LAG * 1000LL){
+		// Too late (host stalled): move the origin instead of running in a burst
+		time_zero.tv_sec += lag / 1000000000;
+		time_zero.tv_nsec += lag % 1000000000;
+		if(time_zero.tv_nsec >= 1000000000){
+			time_zero.tv_sec++;
+			time_zero.tv_nsec -= 1000000000;
+		}
+	}
+	else if(lag < 0){
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+	}
+	
+	nextQuantum = MCT + options.quantum;
+	
+}
+
+void agc::resetClock(){
+	
+	// Move MCT 0 back in host time, by the time the current MCT takes
+	clock_gettime(CLOCK_MONOTONIC, &time_zero);
+	long long ns = options.pacing ? (long long) (MCT * CYCLE_PERIOD * 1000.0 / options.speed) : 0;
+	time_zero.tv_sec -= ns / 1000000000;
+	time_zero.tv_nsec -= ns % 1000000000;
+	if(time_zero.tv_nsec < 0){
+		time_zero.tv_sec--;
+		time_zero.tv_nsec += 1000000000;
+	}
+	nextQuantum = MCT;
+	
+}
+
+/* a word of erasable (index) or IO (RAMSIZE + index): memories hash to the XOR of their words */
+static inline uint64_t wordHash(uint32_t index, uint16_t value){
+	
+	uint64_t x = ((((uint64_t) index) << 16) | value) * 0x9E3779B97F4A7C15ull;
+	return x ^ (x >> 29);
+	
+}
+
+void agc::rehash(){
+	
+	memoryHash = 0;
+	for(int i=256; i<RAMSIZE; i++){
+		memoryHash ^= wordHash(i, RAM[i]);
+	}
+	for(int i=256; i<IOSIZE; i++){
+		memoryHash ^= wordHash(RAMSIZE + i, IO[i]);
 	}
 	
 }
 
+uint64_t agc::stateHash(){
+	
+	// Bank 0 and IO 0-255 are written without storeWord (registers, counters,
+	// inputs): they are hashed here, with the state of a checkpoint
+	uint64_t h = memoryHash;
+	for(int i=0; i<256; i++){
+		h ^= wordHash(i, RAM[i]) ^ wordHash(RAMSIZE + i, IO[i]);
+	}
+	agcCheckpoint state;
+	memset(&state, 0, sizeof(state));//padding included
+	state.steps = steps;
+	saveState(state);
+	const uint8_t *bytes = (const uint8_t*) &state;
+	for(size_t i=0; i<sizeof(state); i++){
+		h = (h ^ bytes[i]) * 1099511628211ull;//FNV-1a
+	}
+	return h;
+	
+}
+
 uint16_t agc::loadWordIO(uint16_t addr){
 	
 	addr = addr >> 1; //One bit shift to the right to skip parity bit
 	if(addr >= 512){
-		cout << "[LOAD IO] Invalid memory access. Termination..." << endl;
-		debug();
-		exit(EXIT_FAILURE);
+		throw ACCESS_IN_IO_MEMORY;
 	}
 	return IO[addr];
 
@@ -203,13 +559,14 @@ void agc::storeWordIO(uint16_t addr, uint16_t value){
 	
 	addr = addr >> 1; //One bit shift to the right to skip parity bit
 	if(addr >= 512){
-		cout << "[STORE IO] Invalid memory access. Termination..." << endl;
-		debug();
-		exit(EXIT_FAILURE);
+		throw ACCESS_IN_IO_MEMORY;
 	}
 	
 	value = checkOverflow(value);
+	if(addr >= 256)
+		memoryHash ^= wordHash(RAMSIZE + addr, IO[addr]) ^ wordHash(RAMSIZE + addr, value);
 	IO[addr] = value;
+	dirtyPages |= (1 << 8) << (addr >> 8);
 	
 	if(addr == 8){
 		dsky.write8(value);
@@ -220,6 +577,9 @@ void agc::storeWordIO(uint16_t addr, uint16_t value){
 	if(addr == 40){
 		dsky.write40(value);
 	}
+	if(addr == 7){//FEB
+		mapBanks();
+	}
 	
 }
 
@@ -299,6 +659,28 @@ void agc::debug(){
 	
 }
 
+void agc::debugDiff(agc &other){
+	
+	cout << "\n\tDIFFERENCES\n" << endl;
+	cout << "\t\t\tTHIS\tOTHER" << endl;
+	for(int i=0; i<RAMSIZE; i++){
+		if(RAM[i] != other.RAM[i])
+			cout << "\tRAM[" << oct << i << "]:\t" << hex << RAM[i] << '\t' << other.RAM[i] << dec << endl;
+	}
+	for(int i=0; i<IOSIZE; i++){
+		if(IO[i] != other.IO[i])
+			cout << "\tIO[" << oct << i << "]:\t" << hex << IO[i] << '\t' << other.IO[i] << dec << endl;
+	}
+	if(MCT != other.MCT)
+		cout << "\tMCT:\t\t" << MCT << '\t' << other.MCT << endl;
+	if(steps != other.steps)
+		cout << "\tsteps:\t\t" << steps << '\t' << other.steps << endl;
+	if(dsky.getStatus() != other.dsky.getStatus())
+		cout << "\tDSKY differs" << endl;
+	cout << endl;
+	
+}
+
 void agc::handlerIOAddress(){
 	
 	if(ADDR < (512 << 1))
@@ -339,7 +721,7 @@ void agc::loadIDTR(){
 	ROM[2048+36] = 0 << 1;	ROM[2048+37] = 36 << 1;	ROM[2048+39] = RADARRUPT << 1;
 	ROM[2048+40] = 0 << 1;	ROM[2048+41] = 40 << 1;	ROM[2048+43] = HANDRUPT << 1;
 	
-	if(verbose) cout << "IDT built.\n";
+	if(options.verbose) cout << "IDT built.\n";
 	
 }
 
@@ -351,16 +733,17 @@ void agc::loadIRegisters(){
 	ZRUPT = Z;
 	BBRUPT = BB;
 	
-	if(verbose) cout << "Interrupting registers loaded\n";
+	if(options.verbose) cout << "Interrupting registers loaded\n";
 	
 }
 
+template<bool VERBOSE>
 void agc::loadInterrupt(){
 	
 	uint16_t addr = IDTR | INT_TYPE;
 	uint16_t present = loadWord(addr);
 	uint16_t type = loadWord(addr + 2);
-	if(verbose) {
+	if(VERBOSE) {
 		cout << "addr present: " << addr << " >> " << ((addr)>>1) << endl;
 		cout << "addr+1 type: " << (addr + (1 << 1)) << " >> " << ((addr + 2)>>1) << endl;
 		cout << "addr+3 addr: " << (addr +  (3 << 1)) << " >> " << ((addr + 6)>>1) << endl;
@@ -370,184 +753,550 @@ void agc::loadInterrupt(){
 	if(present && type != INT_TYPE)
 		throw NO_INTERRUPT;
 	maskInterrupt();
-	if(verbose) cout << "nuovo z: " << (loadWord(addr + 6)>>1) << endl;
+	if(VERBOSE) cout << "nuovo z: " << (loadWord(addr + 6)>>1) << endl;
 	Z = loadWord(addr + 6);
 	
 }
 
-int16_t agc::conv16(uint16_t a){
+template<bool VERBOSE>
+uint16_t agc::latch(aluWord r){
+	
+	if(r.overflow){
+		if(VERBOSE) cout << "Overflow!" << endl;
+		setOverflow();
+		SIGN = A & 0x8000;//from A whatever the operands, as the old sum() and sub()
+	}
+	
+	return r.value;
 	
-	uint32_t sign = a & 0x8000;
-	a = a >> 1;
-	if(sign)
-		a = a + 1;
-	a = a | sign;
+}
 
-	return (int16_t) a;
+template<bool VERBOSE>
+void agc::latch(aluDouble r){
+	
+	if(r.overflow){
+		if(VERBOSE) cout << "Overflow!" << endl;
+		setOverflow();
+		SIGN = r.sign;
+	}
+	
+	A = r.A;
+	L = r.L;
 	
 }
 
-uint16_t agc::reconv16(int16_t a){
+uint16_t agc::loadWord(uint16_t addr){
 	
-	uint16_t sign = a & 0x8000;
-	a = a << 1;
-	if(sign)
-		a = a - 2;
-		
-	return (uint16_t) a;
+	addr = addr >> 1;//One bit shift to the right to skip parity bit
+	if(addr >= 4096){
+		throw ACCESS_IN_FIXED_MEMORY;
+	}
+	
+	return pageTable[addr >> 8][addr & 0b0000000011111111];
 	
 }
 
-int32_t agc::conv32(uint32_t a){
+/* always zero, mapped where the superbanks are wired to return 0 */
+static uint16_t zeroPage[256];
+
+void agc::mapBanks(){
+	
+	// Erasable: 0000-1377 fixed, 1400-1777 banked by EB
+	uint16_t bankIndex = (EB & 0b0000111000000000) >> 9;
+	pageTable[0] = &RAM[0];
+	pageTable[1] = &RAM[256];
+	pageTable[2] = &RAM[512];
+	pageTable[3] = &RAM[bankIndex * 256];
+	
+	// Fixed: 2000-3777 banked by FB (and FEB for superbanks), 4000-7777 fixed
+	uint16_t *bank;
+	bankIndex = (FB & 0b1111100000000000) >> 11;
+	if(bankIndex >= 24 && (FEB & 0b0000000010000000)){//Access to superbanks
+		if(bankIndex < 28)
+			bank = &ROM[(bankIndex + 8) * 1024];
+		else
+			bank = NULL;//This area is wired to return 0
+	}
+	else
+		bank = &ROM[bankIndex * 1024];
+	for(int i=0; i<4; i++){
+		pageTable[4 + i] = bank ? bank + (i * 256) : zeroPage;
+	}
+	for(int i=8; i<16; i++){
+		pageTable[i] = &ROM[i * 256];
+	}
+	
+}
 
-	uint32_t sign = a & 0x80000000;
+bool agc::loadImage(const char *path, bool erasable){
 	
-	a = a >> 1;
-																					// SDDDDDDDDDDDDDDP
-	uint32_t aA = ((a & 0x7FFF0000) >> 2) | sign | (sign >> 1) | (sign >> 2);		// 0SDDDDDDDDDDDDDDP0000000000000000 (>> 2) 000SDDDDDDDDDDDDDDP0000000000000 (& 0x7FFE) 0000DDDDDDDDDDDDDD00000000000000 (| sign[]) SSSSDDDDDDDDDDDDDD00000000000000
-	uint32_t aL = (a & 0x00003FFF);													// 00000000000000000SDDDDDDDDDDDDDD0 (>> 1) 00000000000000000SDDDDDDDDDDDDDD (& 0x3FFF) 000000000000000000DDDDDDDDDDDDDD
+	ifstream file(path, ios::binary);
+	if(!file)
+		return false;
 	
-	a = aA | aL;
-	if(sign)
-		a = a + 1;
+	if(!erasable)
+		writableROM();
+	uint16_t *memory = erasable ? RAM : ROM;
+	file.read((char*) memory, (erasable ? RAMSIZE : ROMSIZE) * sizeof(uint16_t));
+	rehash();
 	
-	return (int32_t) (a);
+	// Code and banks may have changed under the caches
+	mapBanks();
+	dirtyPages = (1 << CHECKPOINT_PAGES) - 1;
+	clearDecodeCache();
+	clearBlockCache();
+	return true;
 	
 }
 
-uint32_t agc::reconv32(int32_t a){
+void agc::writableROM(){
+	
+	if(romData.use_count() > 1){
+		romData = make_shared<vector<uint16_t> >(*romData);
+		ROM = romData->data();
+		mapBanks();
+	}
 	
-	uint32_t sign = (a & 0x80000000) >> 16;
-	a = a << 1;
+}
 
-	if(sign)
-		a = a - 2;
+template<class STATE>
+void agc::saveState(STATE &state){
+	
+	state.MCT = MCT;
+	state.T4INC = T4INC;
+	state.OPCODE = OPCODE;
+	state.ADDR = ADDR;
+	state.INT_TYPE = INT_TYPE;
+	state.SIGN = SIGN;
+	state.S = S;
+	state.B = B;
+	state.MASKINTR = MASKINTR;
+	state.INTR = INTR;
+	state.EXT = EXT;
+	state.OW = OW;
+	state.INX = INX;
+	dsky.save(state.dsky);
 	
-	L = (a & 0x00007FFE) | sign;
-	A = ((a >> 14) & 0x00007FFE) | sign;	
+}
+
+template<class STATE>
+void agc::loadState(const STATE &state){
+	
+	MCT = state.MCT;
+	T4INC = state.T4INC;
+	OPCODE = state.OPCODE;
+	ADDR = state.ADDR;
+	INT_TYPE = state.INT_TYPE;
+	SIGN = state.SIGN;
+	S = state.S;
+	B = state.B;
+	MASKINTR = state.MASKINTR;
+	INTR = state.INTR;
+	EXT = state.EXT;
+	OW = state.OW;
+	INX = state.INX;
+	dsky.load(state.dsky);
 	
-	return ((A << 16) | L);
+}
+
+bool agc::saveSnapshot(const char *path){
+	
+	agcSnapshot *snapshot = new agcSnapshot();
+	memcpy(snapshot->magic, SNAPSHOT_MAGIC, sizeof(snapshot->magic));
+	snapshot->version = SNAPSHOT_VERSION;
+	snapshot->size = sizeof(agcSnapshot);
+	memcpy(snapshot->RAM, RAM, sizeof(RAM));
+	memcpy(snapshot->ROM, ROM, ROMSIZE * sizeof(uint16_t));
+	memcpy(snapshot->IO, IO, sizeof(IO));
+	saveState(*snapshot);
+	
+	// Written aside and renamed, a reader never sees half a snapshot
+	string temp = string(path) + ".tmp";
+	ofstream file(temp.c_str(), ios::binary | ios::trunc);
+	file.write((const char*) snapshot, sizeof(agcSnapshot));
+	file.close();
+	delete snapshot;
+	if(!file || rename(temp.c_str(), path) != 0){
+		unlink(temp.c_str());
+		return false;
+	}
+	return true;
 	
 }
 
-uint16_t agc::sum(uint16_t a, uint16_t b){
+bool agc::loadSnapshot(const char *path){
+	
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size != sizeof(agcSnapshot)){
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, sizeof(agcSnapshot), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return false;
+	
+	const agcSnapshot *snapshot = (const agcSnapshot*) map;
+	bool valid = memcmp(snapshot->magic, SNAPSHOT_MAGIC, sizeof(snapshot->magic)) == 0
+		&& snapshot->version == SNAPSHOT_VERSION && snapshot->size == sizeof(agcSnapshot);
+	if(valid){
+		memcpy(RAM, snapshot->RAM, sizeof(RAM));
+		writableROM();
+		memcpy(ROM, snapshot->ROM, ROMSIZE * sizeof(uint16_t));
+		memcpy(IO, snapshot->IO, sizeof(IO));
+		loadState(*snapshot);
+		rehash();
 		
-	int16_t as = conv16(a);
-	int16_t bs = conv16(b);
+		mapBanks();
+		dirtyPages = (1 << CHECKPOINT_PAGES) - 1;
+		clearDecodeCache();
+		clearBlockCache();
+		resetClock();
+	}
+	munmap(map, sizeof(agcSnapshot));
+	return valid;
+	
+}
 
-	if((bs > 0 && as > INT15_MAX - bs) || (bs < 0 && as < INT15_MIN - bs)){
-		if(verbose) cout << "Overflow!" << endl;
-		setOverflow();
-		SIGN = A & 0x8000;
+void agc::requestSnapshot(){
+	requests.fetch_or(REQUEST_SNAPSHOT);
+}
+
+void agc::requestStop(){
+	requests.fetch_or(REQUEST_STOP);
+}
+
+bool agc::serveRequests(){
+	
+	int served = requests.exchange(0);
+	if(served & REQUEST_INPUT){
+		agcInput input;
+		uint64_t taken = 0;
+		while(pending.front(input)){
+			// A key waits for the KEYRUPT of the previous one, or IO[12] would be overwritten before it is read,
+			// and for its gap (a reboot or a restore behind keyMCT ends it)
+			if(input.kind == INPUT_KEY && ((INTR && INT_TYPE == INT_KEYRUPT) || (MCT >= keyMCT && MCT - keyMCT < input.gap))){
+				requests.fetch_or(REQUEST_INPUT);	// try again after the next instruction
+				break;
+			}
+			pending.pop();
+			takeInput(input);
+			if(input.kind == INPUT_KEY)
+				keyMCT = MCT;
+			taken++;
+		}
+		if(taken){
+			takenInputs.fetch_add(taken, memory_order_release);
+			dsky.wake();	// a sequence of /keys may wait for them
+		}
+	}
+	if(served & REQUEST_SNAPSHOT){
+		if(saveSnapshot(options.snapshot.c_str()))
+			cout << "Snapshot saved to " << options.snapshot << " at MCT " << MCT << endl;
+		else
+			cerr << "Cannot save snapshot to " << options.snapshot << endl;
+	}
+	return served & REQUEST_STOP;
+	
+}
+
+bool agc::startCheckpoints(const char *path, long unsigned period){
+	
+	stopCheckpoints();
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+		return false;
+	checkpointHeader header;
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.size = sizeof(agcCheckpoint);
+	if(write(fd, &header, sizeof(header)) != sizeof(header)){
+		close(fd);
+		return false;
 	}
 	
-	return reconv16(as+bs);
+	// The first checkpoint has every page, the log needs nothing else but the ROM
+	checkpoints = new checkpointLog(fd);
+	checkpointPeriod = period;
+	dirtyPages = (1 << CHECKPOINT_PAGES) - 1;
+	nextLog = MCT;
+	nextEvent = MCT;
+	return true;
 	
 }
 
-uint16_t agc::sub(uint16_t a, uint16_t b){
-		
-	int16_t as = conv16(a);
-	int16_t bs = conv16(b);
+void agc::stopCheckpoints(){
 	
+	delete checkpoints;
+	checkpoints = NULL;
+	nextLog = ULONG_MAX;
+	nextEvent = min(nextHistory, nextReplay);
+	
+}
 
-	if((bs < 0 && as > INT15_MAX + bs) || (bs > 0 && as < INT15_MIN + bs)){
-		if(verbose) cout << "Overflow!" << endl;
-		setOverflow();
-		SIGN = A & 0x8000;
+void agc::fillCheckpoint(vector<char> &record, uint32_t pages){
+	
+	size_t size = sizeof(agcCheckpoint) + __builtin_popcount(pages) * 256 * sizeof(uint16_t);
+	record.resize(size);
+	agcCheckpoint *state = (agcCheckpoint*) record.data();
+	state->size = size;
+	state->pages = pages;
+	state->steps = steps;
+	saveState(*state);
+	uint16_t *page = (uint16_t*) (state + 1);
+	for(int i=0; i<CHECKPOINT_PAGES; i++){
+		if(pages & (1 << i)){
+			memcpy(page, i < 8 ? &RAM[i * 256] : &IO[(i - 8) * 256], 256 * sizeof(uint16_t));
+			page += 256;
+		}
 	}
-		
-	return reconv16(as-bs);
-		
+	
 }
 
-void agc::mul(uint16_t a, uint16_t b){
-		
-	int32_t as = conv16(a);
-	int32_t bs = conv16(b);
+void agc::applyCheckpoint(const agcCheckpoint &state){
 	
-	int32_t p = as * bs;
+	const uint16_t *page = (const uint16_t*) (&state + 1);
+	for(int i=0; i<CHECKPOINT_PAGES; i++){
+		if(state.pages & (1 << i)){
+			memcpy(i < 8 ? &RAM[i * 256] : &IO[(i - 8) * 256], page, 256 * sizeof(uint16_t));
+			page += 256;
+		}
+	}
+	steps = state.steps;
+	loadState(state);
+	rehash();
 	
-	if(((bs > 0 && as < INT29_MIN/bs) || (bs < -1 && as > INT29_MIN/bs) || (bs == -1 && as == INT29_MIN)) || ((bs > 0 && as > INT29_MAX/bs) || (bs < 0 && as < INT29_MAX/bs))){
-		if(verbose) cout << "Overflow!" << endl;
-		setOverflow();
-		SIGN = A & 0x80000000;
+}
+
+void agc::timedEvents(){
+	
+	// Checkpoints come before the inputs taken at the same MCT: a machine
+	// restored from one takes them again
+	if(MCT >= nextLog){//a few KB copied here, the writer thread does the rest
+		vector<char> record;
+		fillCheckpoint(record, dirtyPages | CHECKPOINT_ALWAYS);
+		checkpoints->append(record);
+		dirtyPages = 0;
+		nextLog = MCT + checkpointPeriod;
+	}
+	
+	if(MCT >= nextHistory){
+		if(history.size() >= historyDepth){
+			history.push_back(vector<char>());
+			history.back().swap(history.front());//reuses the oldest buffer
+			history.pop_front();
+			// Inputs before the oldest checkpoint are never taken again
+			long unsigned oldest = ((const agcCheckpoint*) history.front().data())->steps;
+			while(!inputs.empty() && inputs.front().steps < oldest)
+				inputs.pop_front();
+		}
+		else
+			history.push_back(vector<char>());
+		fillCheckpoint(history.back(), (1 << CHECKPOINT_PAGES) - 1);
+		nextHistory = MCT + HISTORY_PERIOD;
+	}
+	
+	while(!replay.empty() && replay.front().mct <= MCT){
+		takeInput(replay.front());
+		replay.pop_front();
 	}
+	nextReplay = replay.empty() ? ULONG_MAX : replay.front().mct;
 	
-	reconv32(p);
+	nextEvent = min(min(nextLog, nextHistory), nextReplay);
 	
 }
 
-void agc::div(uint16_t b){
-		
-	uint32_t A32 = (((uint32_t) A) << 16);
-	uint32_t L32 = ((uint32_t) L);
-	int32_t as = conv32(A32 | L32);
-	int32_t bs = conv16(b);
+bool agc::loadCheckpoint(const char *path, long unsigned mct){
+	
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size < (off_t) (sizeof(checkpointHeader) + sizeof(agcCheckpoint))){
+		close(fd);
+		return false;
+	}
+	size_t length = info.st_size;
+	void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+		return false;
+	
+	const char *data = (const char*) map;
+	const checkpointHeader *header = (const checkpointHeader*) data;
+	const agcCheckpoint *first = (const agcCheckpoint*) (header + 1);
+	bool valid = memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) == 0
+		&& header->version == CHECKPOINT_VERSION && header->size == sizeof(agcCheckpoint)
+		&& first->pages == (1 << CHECKPOINT_PAGES) - 1 && first->MCT <= mct;
+	
+	// Pages in order up to the last checkpoint not after mct; a record cut
+	// short (the writer was killed) or whose size does not match its pages ends the log
+	const agcCheckpoint *last = NULL;
+	size_t offset = sizeof(checkpointHeader);
+	while(valid && offset + sizeof(agcCheckpoint) <= length){
+		const agcCheckpoint *state = (const agcCheckpoint*) (data + offset);
+		size_t size = sizeof(agcCheckpoint) + __builtin_popcount(state->pages) * 256 * sizeof(uint16_t);
+		if(state->MCT > mct || (state->pages >> CHECKPOINT_PAGES) != 0 || state->size != size || offset + size > length)
+			break;
+		applyCheckpoint(*state);
+		last = state;
+		offset += state->size;
+	}
+	
+	if(last){
+		mapBanks();
+		dirtyPages = (1 << CHECKPOINT_PAGES) - 1;
+		clearDecodeCache();
+		clearBlockCache();
+		resetClock();
+	}
+	munmap(map, length);
+	return last != NULL;
+	
+}
 
-	if(bs == 0)
-		throw NO_DIVISION;
+void agc::startHistory(long unsigned seconds){
 	
-	int32_t dividend = (as / bs);
-	int32_t remainder = (as % bs) & 0x0000EFFF;
+	// Steps are counted by the interpreter: blocks would run many of them at once
+	options.blockEngine = false;
+	options.aotEngine = false;
+	historyDepth = max(seconds * 1000000 / (HISTORY_PERIOD * CYCLE_PERIOD), 1ul);
+	nextHistory = MCT;
+	nextEvent = MCT;
 	
-	if((as == INT29_MIN) && (bs == -1)){
-		cout << "Overflow!" << endl;
-		setOverflow();
-		SIGN = A & 0x80000000;
+}
+
+long unsigned agc::getSteps(){
+	return steps;
+}
+
+int agc::step(){
+	
+	// An iteration of emulateLoop through the interpreter, after the inputs
+	// that were taken at this step
+	try{
+		if(steps == nextInput)
+			pressRecorded();
+		if(options.boundsChecks)
+			predecode<true>(Z);
+		else
+			predecode<false>(Z);
+		exec<false>();
+		subroutine();
+		interrupt<false>();
+		specialroutine();
+		steps++;
+	}catch(int e){
+		exceptions(e);
+		return e;
 	}
 	
-	dividend = dividend  << 14;       			 //00000000000001
+	dsky.toggleBlinker(MCT);
+	dsky.clearStrobes(MCT);
+	return NO_FAULT;
 	
-	int32_t d = dividend | remainder;
+}
+
+static bool takenBefore(const agcInput &input, long unsigned steps){
+	return input.steps < steps;
+}
+
+void agc::pressRecorded(){
 	
-	reconv32(d);
+	auto input = lower_bound(inputs.begin(), inputs.end(), steps, takenBefore);
+	for(; input != inputs.end() && input->steps == steps; input++)
+		applyInput(*input);
+	nextInput = (input != inputs.end()) ? input->steps : ULONG_MAX;
 	
 }
 
-uint16_t agc::loadWord(uint16_t addr){
+bool agc::replayTo(long unsigned target){
 	
-	addr = addr >> 1;//One bit shift to the right to skip parity bit
-	if(addr >= 4096){
-		cout << "[LOAD] Invalid memory access. Termination..." << endl;
-		debug();
-		exit(EXIT_FAILURE);
+	size_t i = history.size();
+	while(i > 0 && ((const agcCheckpoint*) history[i - 1].data())->steps > target)
+		i--;
+	if(i == 0)
+		return false;
+	
+	applyCheckpoint(*(const agcCheckpoint*) history[i - 1].data());
+	mapBanks();
+	dirtyPages = (1 << CHECKPOINT_PAGES) - 1;
+	for(int j=0; j<RAMSIZE; j++){//ROM has not changed, erasable has
+		invalidateDecode(ROMSIZE + j);
 	}
+	fault = NO_FAULT;
+	auto input = lower_bound(inputs.begin(), inputs.end(), steps, takenBefore);
+	nextInput = (input != inputs.end()) ? input->steps : ULONG_MAX;
 	
-	if(addr < 1024){//RAM access				BIT 12-11 == 00
-		if(addr < 768){//fixed RAM
-			return RAM[addr];
-		}
-		else{//banked RAM
-			uint16_t bankIndex = (EB & 0b0000111000000000) >> 9;
-			return RAM[(bankIndex * 256) + (addr & 0b0000000011111111)];
-		}
+	while(steps < target){
+		if(step() != NO_FAULT)
+			return false;
 	}
-	else{//ROM access							BIT 12-11 != 00
-		if(addr < 2048){//banked ROM
-			uint16_t bankIndex = (FB & 0b1111100000000000) >> 11;
-			if(bankIndex >= 24){
-				if(FEB & 0b0000000010000000){//Access to superbanks
-					if(bankIndex < 28){
-						cout << "Addr: " << addr  << endl;
-						return ROM[((bankIndex + 8) * 1024) + (addr & 0b0000001111111111)];
-					}
-					else{
-						return 0;//This area is wired to return 0
-					}
-				}
-				else{
-					return ROM[(bankIndex * 1024) + (addr & 0b0000001111111111)];
-				}
-			}
-			else{
-				return ROM[(bankIndex * 1024) + (addr & 0b0000001111111111)];
-			}
-		}
-		else{//fixed ROM
-			return ROM[addr];
+	return true;
+	
+}
+
+bool agc::travel(long unsigned target){
+	
+	if(target == steps)
+		return true;
+	return replayTo(target);
+	
+}
+
+bool agc::stepBack(long unsigned n){
+	return n <= steps && travel(steps - n);
+}
+
+bool agc::findBack(){
+	
+	// Newest interval first: each one runs again from its checkpoint to where
+	// the next one starts, the last hit in it wins. The step that led to the
+	// current state is not searched, so that repeated calls go further back.
+	long unsigned now = steps;
+	long unsigned end = now - 1;
+	for(size_t i = history.size(); i > 0 && now > 0; i--){
+		long unsigned start = ((const agcCheckpoint*) history[i - 1].data())->steps;
+		if(start >= end)
+			continue;
+		replayTo(start);
+		long unsigned found = ULONG_MAX;
+		while(steps < end){
+			watchHit = false;
+			if(step() != NO_FAULT)
+				break;
+			if(watchHit)
+				found = steps;
 		}
+		if(found != ULONG_MAX)
+			return replayTo(found);
+		end = start;
 	}
+	replayTo(now);
+	return false;
+	
+}
+
+bool agc::lastWrite(uint16_t addr){
+	
+	if(addr >= 1024)
+		return false;
+	watchIndex = (pageTable[addr >> 8] - RAM) + (addr & 0b0000000011111111);//banked as EB is now
+	bool found = findBack();
+	watchIndex = -1;
+	return found;
+	
+}
+
+bool agc::lastInterrupt(){
+	
+	watchInterrupt = true;
+	bool found = findBack();
+	watchInterrupt = false;
+	return found;
 	
 }
 
@@ -578,23 +1327,19 @@ void agc::storeWord(uint16_t addr, uint16_t value){
 	
 	addr = addr >> 1;//One bit shift to the right to skip parity bit
 	if(addr >= 1024){
-		cout << "[STORE MEM] Invalid memory access. Termination..." << endl;
-		debug();
-		exit(EXIT_FAILURE);
+		throw ACCESS_IN_FIXED_MEMORY;//fixed memory is read-only
 	}
 	
-	int RAMIndex;
 	value = checkOverflow(value);
 	
-	if(addr < 768){//fixed RAM
-		RAMIndex = addr;
-	}
-	else{//banked RAM
-		uint16_t bankIndex = (EB & 0b0000111000000000) >> 9;
-		RAMIndex = (bankIndex * 256) + (addr & 0b0000000011111111);
-	}
-	
+	int RAMIndex = (pageTable[addr >> 8] - RAM) + (addr & 0b0000000011111111);
+	if(RAMIndex >= 256)
+		memoryHash ^= wordHash(RAMIndex, RAM[RAMIndex]) ^ wordHash(RAMIndex, value);
 	RAM[RAMIndex] = value;
+	dirtyPages |= 1 << (RAMIndex >> 8);
+	if(RAMIndex == watchIndex)
+		watchHit = true;
+	invalidateDecode(ROMSIZE + RAMIndex);
 	if(RAMIndex == 3)//Fix redundancy in BB
 		RAM[6] = (value >> 8) & 0b0000000000000111;
 	if(RAMIndex == 4)//Fix redundancy in BB
@@ -603,6 +1348,8 @@ void agc::storeWord(uint16_t addr, uint16_t value){
 		RAM[3] = (value << 8) & 0b0000111000000000;
 		RAM[3] = value & 0b1111100000000000;
 	}
+	if(RAMIndex == 3 || RAMIndex == 4 || RAMIndex == 6)
+		mapBanks();
 	
 	return;
 	
@@ -627,6 +1374,7 @@ void agc::fetch(uint16_t word){
 	S = loadWord(word);
 }
 
+template<bool VERBOSE, bool CHECKED>
 void agc::decode(uint16_t word){
 	
 	OPCODE = (word >> 13) & 0b00000111;
@@ -635,37 +1383,37 @@ void agc::decode(uint16_t word){
 		switch(OPCODE){
 			case 0://XXALQ, XLQ, RETURN, RELINT, INHINT, EXTEND
 				if(((word & 0b0001111111111110) >> 1) == 0){
-					if(verbose) cout << "\tOPCODE:\t XXALQ\n";
+					if(VERBOSE) cout << "\tOPCODE:\t XXALQ\n";
 					OPCODE = XXALQ;
 					setMCT(1);
 				}
 				else if(((word & 0b0001111111111110) >> 1) == 1){
-					if(verbose) cout << "\tOPCODE:\t XLQ\n";
+					if(VERBOSE) cout << "\tOPCODE:\t XLQ\n";
 					OPCODE = XLQ;
 					setMCT(1);
 				}
 				else if(((word & 0b0001111111111110) >> 1) == 2){
-					if(verbose) cout << "\tOPCODE:\t RETURN\n";
+					if(VERBOSE) cout << "\tOPCODE:\t RETURN\n";
 					OPCODE = RETURN;
 					setMCT(2);
 				}
 				else if(((word & 0b0001111111111110) >> 1) == 3){
-					if(verbose) cout << "\tOPCODE:\t RELINT\n";
+					if(VERBOSE) cout << "\tOPCODE:\t RELINT\n";
 					OPCODE = RELINT;
 					setMCT(1);
 				}
 				else if(((word & 0b0001111111111110) >> 1) == 4){
-					if(verbose) cout << "\tOPCODE:\t INHINT\n";
+					if(VERBOSE) cout << "\tOPCODE:\t INHINT\n";
 					OPCODE = INHINT;
 					setMCT(1);
 				}
 				else if(((word & 0b0001111111111110) >> 1) == 6){
-					if(verbose) cout << "\tOPCODE:\t EXTEND\n";
+					if(VERBOSE) cout << "\tOPCODE:\t EXTEND\n";
 					OPCODE = EXTEND;
 					setMCT(1);
 				}
 				else{
-					if(verbose) cout << "\tOPCODE:\t TC\n";
+					if(VERBOSE) cout << "\tOPCODE:\t TC\n";
 					OPCODE = TC;
 					ADDR = (word & 0b0001111111111110);
 					setMCT(1);
@@ -673,37 +1421,37 @@ void agc::decode(uint16_t word){
 				break;
 			case 1://CCS, TCF
 				if(((word & 0b0001100000000000) >> 11) == 0){
-					if(verbose) cout << "\tOPCODE:\t CCS\n";
+					if(VERBOSE) cout << "\tOPCODE:\t CCS\n";
 					OPCODE = CCS;
 					setMCT(2);
 					ADDR = (word & 0b0000011111111110);
-					handlerErasableMemAddress();
+					if(CHECKED) handlerErasableMemAddress();
 				}
 				else{
-					if(verbose) cout << "\tOPCODE:\t TCF\n";
+					if(VERBOSE) cout << "\tOPCODE:\t TCF\n";
 					OPCODE = TCF;
 					setMCT(1);
 					ADDR = (word & 0b0001111111111110);
-					handlerFixedMemAddress();
+					if(CHECKED) handlerFixedMemAddress();
 				}
 				break;
 			case 2://DAS, LXCH, INCR, ADS
 				ADDR = (word & 0b0000011111111110);
-				handlerErasableMemAddress();
+				if(CHECKED) handlerErasableMemAddress();
 				if(((word & 0b0001100000000000) >> 11) == 0){
-					if(verbose) cout << "\tOPCODE:\t DAS\n";
+					if(VERBOSE) cout << "\tOPCODE:\t DAS\n";
 					OPCODE = DAS;
 					setMCT(3);
 				}else if(((word & 0b0001100000000000) >> 11) == 1){
-					if(verbose) cout << "\tOPCODE:\t LXCH\n";
+					if(VERBOSE) cout << "\tOPCODE:\t LXCH\n";
 					OPCODE = LXCH;
 					setMCT(2);
 				}else if(((word & 0b0001100000000000) >> 11) == 2){
-					if(verbose) cout << "\tOPCODE:\t INCR\n";
+					if(VERBOSE) cout << "\tOPCODE:\t INCR\n";
 					OPCODE = INCR;
 					setMCT(2);
 				}else if(((word & 0b0001100000000000) >> 11) == 3){
-					if(verbose) cout << "\tOPCODE:\t ADS\n";
+					if(VERBOSE) cout << "\tOPCODE:\t ADS\n";
 					OPCODE = ADS;
 					setMCT(2);
 				}
@@ -713,50 +1461,50 @@ void agc::decode(uint16_t word){
 				setMCT(2);
 				ADDR = (word & 0b0001111111111110);
 				if(ADDR == 0){
-					if(verbose) cout << "\tOPCODE:\t NOOP\n";
+					if(VERBOSE) cout << "\tOPCODE:\t NOOP\n";
 				}else
-					if(verbose) cout << "\tOPCODE:\t CA\n";
+					if(VERBOSE) cout << "\tOPCODE:\t CA\n";
 				break;
 			case 4://CS
-				if(verbose) cout << "\tOPCODE:\t CS\n";
+				if(VERBOSE) cout << "\tOPCODE:\t CS\n";
 				OPCODE = CS;
 				setMCT(2);
 				ADDR = (word & 0b0001111111111110);
 				break;
 			case 5://INDEX, DXCH, TS, XCH, RESUME
 				ADDR = (word & 0b0000011111111110);
-				handlerErasableMemAddress();
+				if(CHECKED) handlerErasableMemAddress();
 				if(((word & 0b0001100000000000) >> 11) == 0){
 					if((ADDR >> 1) == 17){
-						if(verbose) cout << "\tOPCODE:\t RESUME\n";
+						if(VERBOSE) cout << "\tOPCODE:\t RESUME\n";
 						OPCODE = RESUME;
 					}else{
-						if(verbose) cout << "\tOPCODE:\t INDEX\n";
+						if(VERBOSE) cout << "\tOPCODE:\t INDEX\n";
 						OPCODE = INDEX;
 					}
 					setMCT(2);
 				}else if(((word & 0b0001100000000000) >> 11) == 1){
-					if(verbose) cout << "\tOPCODE:\t DXCH\n";
+					if(VERBOSE) cout << "\tOPCODE:\t DXCH\n";
 					OPCODE = DXCH;
 					setMCT(3);
 				}else if(((word & 0b0001100000000000) >> 11) == 2){
-					if(verbose) cout << "\tOPCODE:\t TS\n";
+					if(VERBOSE) cout << "\tOPCODE:\t TS\n";
 					OPCODE = TS;
 					setMCT(2);
 				}else if(((word & 0b0001100000000000) >> 11) == 3){
-					if(verbose) cout << "\tOPCODE:\t XCH\n";
+					if(VERBOSE) cout << "\tOPCODE:\t XCH\n";
 					OPCODE = XCH;
 					setMCT(2);
 				}
 				break;
 			case 6://AD
-				if(verbose) cout << "\tOPCODE:\t AD\n";
+				if(VERBOSE) cout << "\tOPCODE:\t AD\n";
 				OPCODE = AD;
 				setMCT(2);
 				ADDR = (word & 0b0001111111111110);
 				break;
 			case 7://MASK
-				if(verbose) cout << "\tOPCODE:\t MASK\n";
+				if(VERBOSE) cout << "\tOPCODE:\t MASK\n";
 				OPCODE = MASK;
 				setMCT(2);
 				ADDR = (word & 0b0001111111111110);
@@ -769,113 +1517,113 @@ void agc::decode(uint16_t word){
 		switch(OPCODE){
 			case 0://READ, WRITE, RAND, WAND, ROR, WOR, RXOR
 				ADDR = (word & 0b0000001111111110);
-				handlerIOAddress();
+				if(CHECKED) handlerIOAddress();
 				if(((word & 0b0001110000000000) >> 10) == 0){
-					if(verbose) cout << "\tOPCODE:\t READ\n";
+					if(VERBOSE) cout << "\tOPCODE:\t READ\n";
 					OPCODE = READ;
 					setMCT(2);
 				}
 				else if(((word & 0b0001110000000000) >> 10) == 1){
-					if(verbose) cout << "\tOPCODE:\t WRITE\n";
+					if(VERBOSE) cout << "\tOPCODE:\t WRITE\n";
 					OPCODE = WRITE;
 					setMCT(2);
 				}else if(((word & 0b0001110000000000) >> 10) == 2){
-					if(verbose) cout << "\tOPCODE:\t RAND\n";
+					if(VERBOSE) cout << "\tOPCODE:\t RAND\n";
 					OPCODE = RAND;
 					setMCT(2);
 				}else if(((word & 0b0001110000000000) >> 10) == 3){
-					if(verbose) cout << "\tOPCODE:\t WAND\n";
+					if(VERBOSE) cout << "\tOPCODE:\t WAND\n";
 					OPCODE = WAND;
 					setMCT(2);
 				}else if(((word & 0b0001110000000000) >> 10) == 4){
-					if(verbose) cout << "\tOPCODE:\t ROR\n";
+					if(VERBOSE) cout << "\tOPCODE:\t ROR\n";
 					OPCODE = ROR;
 					setMCT(2);
 				}else if(((word & 0b0001110000000000) >> 10) == 5){
-					if(verbose) cout << "\tOPCODE:\t WOR\n";
+					if(VERBOSE) cout << "\tOPCODE:\t WOR\n";
 					OPCODE = WOR;
 					setMCT(2);
 				}else if(((word & 0b0001110000000000) >> 10) == 6){
-					if(verbose) cout << "\tOPCODE:\t RXOR\n";
+					if(VERBOSE) cout << "\tOPCODE:\t RXOR\n";
 					OPCODE = RXOR;
 					setMCT(2);
 				}else if(((word & 0b0001110000000000) >> 10) == 7){
-					if(verbose) cout << "\tOPCODE:\t ALT\n";
+					if(VERBOSE) cout << "\tOPCODE:\t ALT\n";
 					OPCODE = ALT;
 					setMCT(3);
 				}
 				break;
 			case 1://DV, BZF
 				if(((word & 0b0001100000000000) >> 11) == 0){
-					if(verbose) cout << "\tOPCODE:\t DV\n";
+					if(VERBOSE) cout << "\tOPCODE:\t DV\n";
 					OPCODE = DV;
 					setMCT(6);
 					ADDR = (word & 0b0000011111111110);
 				}
 				else{
-					if(verbose) cout << "\tOPCODE:\t BZF\n";
+					if(VERBOSE) cout << "\tOPCODE:\t BZF\n";
 					OPCODE = BZF;
 					setMCT(1);
 					ADDR = (word & 0b0001111111111110);
-					handlerFixedMemAddress();
+					if(CHECKED) handlerFixedMemAddress();
 				}
 				break;
 			case 2://MSU, QXCH, AUG, DIM
 				ADDR = (word & 0b0000011111111110);
-				handlerErasableMemAddress();
+				if(CHECKED) handlerErasableMemAddress();
 				if(((word & 0b0001100000000000) >> 11) == 0){
-					if(verbose) cout << "\tOPCODE:\t MSU\n";
+					if(VERBOSE) cout << "\tOPCODE:\t MSU\n";
 					OPCODE = MSU;
 					setMCT(2);
 				}else if(((word & 0b0001100000000000) >> 11) == 1){
-					if(verbose) cout << "\tOPCODE:\t QXCH\n";
+					if(VERBOSE) cout << "\tOPCODE:\t QXCH\n";
 					OPCODE = QXCH;
 					setMCT(2);
 				}else if(((word & 0b0001100000000000) >> 11) == 2){
-					if(verbose) cout << "\tOPCODE:\t AUG\n";
+					if(VERBOSE) cout << "\tOPCODE:\t AUG\n";
 					OPCODE = AUG;
 					setMCT(2);
 				}else if(((word & 0b0001100000000000) >> 11) == 3){
-					if(verbose) cout << "\tOPCODE:\t DIM\n";
+					if(VERBOSE) cout << "\tOPCODE:\t DIM\n";
 					OPCODE = DIM;
 					setMCT(2);
 				}
 				break;
 			case 3://DCA
-				if(verbose) cout << "\tOPCODE:\t DCA\n";
+				if(VERBOSE) cout << "\tOPCODE:\t DCA\n";
 				OPCODE = DCA;
 				setMCT(3);
 				ADDR = (word & 0b0001111111111110);
 				break;
 			case 4://DCS
-				if(verbose) cout << "\tOPCODE:\t DCS\n";
+				if(VERBOSE) cout << "\tOPCODE:\t DCS\n";
 				OPCODE = DCS;
 				setMCT(3);
 				ADDR = (word & 0b0001111111111110);
 				break;
 			case 5://INDEX_EXTENDED
-				if(verbose) cout << "\tOPCODE:\t INDEX_EXT\n";
+				if(VERBOSE) cout << "\tOPCODE:\t INDEX_EXT\n";
 				OPCODE = INDEX_EXT;
 				ADDR = (word & 0b0001111111111110);
 				break;
 			case 6://SU, BZMF
 				if(((word & 0b0001100000000000) >> 11) == 0){
-					if(verbose) cout << "\tOPCODE:\t SU\n";
+					if(VERBOSE) cout << "\tOPCODE:\t SU\n";
 					OPCODE = SU;
 					setMCT(2);
 					ADDR = (word & 0b0000011111111110);
-					handlerErasableMemAddress();
+					if(CHECKED) handlerErasableMemAddress();
 				}
 				else{
-					if(verbose) cout << "\tOPCODE:\t BZMF\n";
+					if(VERBOSE) cout << "\tOPCODE:\t BZMF\n";
 					OPCODE = BZMF;
 					setMCT(1);
 					ADDR = (word & 0b0001111111111110);
-					handlerFixedMemAddress();
+					if(CHECKED) handlerFixedMemAddress();
 				}
 				break;
 			case 7://MP
-				if(verbose) cout << "\tOPCODE:\t MP\n";
+				if(VERBOSE) cout << "\tOPCODE:\t MP\n";
 				OPCODE = MP;
 				setMCT(3);
 				ADDR = (uint)(word & 0b0001111111111110);
@@ -888,333 +1636,608 @@ void agc::decode(uint16_t word){
 	
 }
 
+int agc::physicalAddress(uint16_t addr){
+	
+	addr = addr >> 1;
+	if(addr >= 4096 || addr < DECODE_FIRST_CACHED)
+		return -1;
+	
+	const uint16_t *page = pageTable[addr >> 8];
+	if(page == zeroPage)
+		return -1;
+	if(addr < 1024)
+		return ROMSIZE + (page - RAM) + (addr & 0b0000000011111111);
+	return (page - ROM) + (addr & 0b0000000011111111);
+	
+}
+
+void agc::invalidateDecode(int index){
+	decodeCache[0][index].valid = false;
+	decodeCache[1][index].valid = false;
+}
+
+void agc::clearDecodeCache(){
+	// Give the pages back: they read as zero (invalid entries) when touched again
+	if(madvise(decodeCache, 2 * sizeof(*decodeCache), MADV_DONTNEED) != 0)
+		memset(decodeCache, 0, 2 * sizeof(*decodeCache));
+}
+
+void agc::allocateCaches(){
+	
+	// Anonymous pages are zero, i.e. invalid entries, and cost nothing until touched
+	void *pages = mmap(NULL, 2 * sizeof(*decodeCache), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(pages == MAP_FAILED)
+		throw bad_alloc();
+	decodeCache = (decodedWord (*)[DECODE_CACHE_SIZE]) pages;
+	blockCache = NULL;
+	
+}
+
+template<bool CHECKED>
+void agc::decodeEntry(uint16_t word, decodedWord &entry){
+	
+	long unsigned mct = MCT;
+	entry.word = word;
+	entry.exception = -1;
+	try{
+		decode<false, CHECKED>(word);
+	}catch(int e){
+		entry.exception = e;
+	}
+	entry.opcode = OPCODE;
+	entry.addr = ADDR;
+	entry.mct = MCT - mct;
+	entry.valid = true;
+	
+}
+
+template<bool CHECKED>
+void agc::predecode(uint16_t addr){
+	
+	int index = physicalAddress(addr);
+	if(index < 0){
+		fetch(addr);
+		decode<false, CHECKED>(S);
+		return;
+	}
+	
+	decodedWord &entry = decodeCache[EXT][index];
+	if(!entry.valid){
+		fetch(addr);
+		decodeEntry<CHECKED>(S, entry);
+		if(entry.exception >= 0)
+			throw (int) entry.exception;
+		return;
+	}
+	
+	S = entry.word;
+	OPCODE = entry.opcode;
+	if(OPCODE > EXTEND)//XXALQ...EXTEND leave ADDR untouched
+		ADDR = entry.addr;
+	setMCT(entry.mct);
+	if(entry.exception >= 0)
+		throw (int) entry.exception;
+	
+}
+
+bool agc::endsBlock(const decodedWord &op){
+	
+	switch(op.opcode){
+		case XXALQ:
+		case XLQ:
+		case RETURN:
+		case RELINT:		// let a pending interrupt be taken
+		case TC:
+		case CCS:
+		case TCF:
+		case RESUME:
+		case INDEX:
+		case DXCH:
+		case TS:			// skips the next word on overflow
+		case BZF:
+		case BZMF:
+		case INDEX_EXT:
+		case ALT:
+			return true;
+		default:{
+			// Any access to EB, FB, Z or BB: the double-word forms reach K+1 too (DAS at 3 writes FB)
+			if(op.opcode <= EXTEND)
+				return false;
+			uint16_t first = op.addr >> 1;
+			bool twoWords = op.opcode == DAS || op.opcode == DCA || op.opcode == DCS;
+			uint16_t last = first + (twoWords ? 1 : 0);
+			return first <= 6 && last >= 3;
+		}
+	}
+	
+}
+
+void agc::clearBlockCache(){
+	if(blockCache == NULL)
+		return;
+	for(int i=0; i<2048; i++){
+		blockCache[0][i].valid = false;
+		blockCache[1][i].valid = false;
+	}
+}
+
+// A block saves the decoding, not the bookkeeping: every word is charged
+// its MCT and followed by timers, interrupts and the DSKY as in the
+// interpreter, and the block is left after any word where the interpreter
+// would take an interrupt, an event or a request. Runs are the same machine
+// on every engine.
+template<bool CHECKED>
+agcBlock* agc::translate(uint16_t addr){
+	
+	addr = addr >> 1;
+	if(addr < 2048 || addr >= 4096)//only fixed-fixed memory does not depend on FB
+		return NULL;
+	
+	if(blockCache == NULL)
+		blockCache = new agcBlock[2][2048]();
+	agcBlock &block = blockCache[EXT][addr - 2048];
+	if(block.valid)
+		return block.code.empty() ? NULL : &block;
+	
+	// Decode the block once, saving the state touched by decode()
+	uint16_t opcode = OPCODE;
+	uint16_t address = ADDR;
+	long unsigned mct = MCT;
+	bool ext = EXT;
+	
+	block.code.clear();
+	for(uint16_t a = addr; a < 4096 && block.code.size() < BLOCK_MAX; a++){
+		decodedWord &entry = decodeCache[EXT][a];
+		if(!entry.valid)
+			decodeEntry<CHECKED>(ROM[a], entry);
+		if(entry.exception >= 0)//the interpreter will raise it
+			break;
+		block.code.push_back(entry);
+		if(endsBlock(entry))
+			break;
+		EXT = (entry.opcode == EXTEND);
+	}
+	block.valid = true;
+	
+	OPCODE = opcode;
+	ADDR = address;
+	MCT = mct;
+	EXT = ext;
+	
+	return block.code.empty() ? NULL : &block;
+	
+}
+
+bool agc::blockStep(){
+	
+	// What the interpreter and its loop do after a word: the block is left
+	// where the loop has work to do before the next one
+	uint16_t next = Z + 2;
+	subroutine();
+	interrupt<false>();
+	specialroutine();
+	steps++;
+	dsky.toggleBlinker(MCT);
+	dsky.clearStrobes(MCT);
+	if(Z != next)//an interrupt was taken, or rupt() rebooted the machine
+		return false;
+	return MCT < nextEvent && MCT < stopMCT && (Z >> 1) != stopZ && !requests.load(memory_order_relaxed);
+	
+}
+
+void agc::blockExit(){
+	
+	subroutine();
+	interrupt<false>();
+	specialroutine();
+	steps++;
+	
+}
+
+void agc::execBlock(const agcBlock &block){
+	
+	size_t last = block.code.size() - 1;
+	for(size_t i = 0; i <= last; i++){
+		const decodedWord &op = block.code[i];
+		S = op.word;
+		OPCODE = op.opcode;
+		if(OPCODE > EXTEND)
+			ADDR = op.addr;
+		setMCT(op.mct);//a fault is charged only the words that ran
+		exec<false>();
+		if(i == last)
+			blockExit();
+		else if(!blockStep())
+			return;
+	}
+	
+}
+
+/* compiled blocks registered by the translation unit made by agc-translate */
+static const aotEntry *aotTable = NULL;
+static int aotTableSize = 0;
+static uint32_t aotTableChecksum = 0;
+
+int aotRegister(const aotEntry *table, int size, uint32_t checksum){
+	
+	aotTable = table;
+	aotTableSize = size;
+	aotTableChecksum = checksum;
+	return size;
+	
+}
+
+uint32_t agc::romChecksum(){
+	
+	uint32_t h = 2166136261u;//FNV-1a
+	for(int i=0; i<ROMSIZE; i++){
+		h = (h ^ ROM[i]) * 16777619u;
+	}
+	return h;
+	
+}
+
+bool agc::loadCompiledBlocks(){
+	
+	for(int i=0; i<2048; i++){
+		compiledCode[0][i] = NULL;
+		compiledCode[1][i] = NULL;
+	}
+	
+	if(aotTableSize == 0 || aotTableChecksum != romChecksum())
+		return false;
+	
+	for(int i=0; i<aotTableSize; i++){
+		compiledCode[aotTable[i].ext][aotTable[i].addr - 2048] = aotTable[i].run;
+	}
+	return true;
+	
+}
+
+aotBlock agc::compiled(uint16_t addr){
+	
+	addr = addr >> 1;
+	if(addr < 2048 || addr >= 4096)
+		return NULL;
+	return compiledCode[EXT][addr - 2048];
+	
+}
+
+template<bool VERBOSE>
 int agc::exec(){
 	
+	// Direct-threaded dispatch: one label per opcode, in agcConstants.h order
+	static void *dispatch[] = {
+		&&op_XXALQ, &&op_XLQ, &&op_RETURN, &&op_RELINT, &&op_INHINT, &&op_EXTEND,
+		&&op_TC, &&op_CCS, &&op_TCF, &&op_DAS, &&op_LXCH, &&op_INCR,
+		&&op_ADS, &&op_CA, &&op_CS, &&op_RESUME, &&op_INDEX, &&op_DXCH,
+		&&op_TS, &&op_XCH, &&op_AD, &&op_MASK, &&op_READ, &&op_WRITE,
+		&&op_RAND, &&op_WAND, &&op_ROR, &&op_WOR, &&op_RXOR, &&op_DV,
+		&&op_BZF, &&op_MSU, &&op_QXCH, &&op_AUG, &&op_DIM, &&op_DCA,
+		&&op_DCS, &&op_INDEX_EXT, &&op_SU, &&op_BZMF, &&op_MP, &&op_ALT
+	};
+	
 	uint16_t temp;
 	
 	unsetIndex();
-	if(verbose) cout << "\tADDR:\t" << (ADDR >> 1) << endl;
-	if(EXT == 0){
-			
-		switch(OPCODE){
-		
-			case XXALQ:															// TC A
-				Q = Z;
-				Z = 0xFFFE;	// Al termine del ciclo, (Z) = 65354 verrà incrementato e diventerà zero, facendo fetching nel primo registro.
-				break;
-						
-			case XLQ:															// TC L
-				Q = Z;
-				Z = 0;
-				break;
-						
-			case RETURN:
-				Z = Q;
-				break;
-						
-			case RELINT:
-				unmaskInterrupt();
-				break;
-			
-			case INHINT:
-				maskInterrupt();
-				break;
-			
-			case EXTEND:
-				setExtended();
-				break;
-					
-			case TC:
-				Q = Z;
-				Z = sub(ADDR, 2);
-				break;
-					
-			case CCS:
-				unsetOverflow();
-				A = loadWord(ADDR);
-				if(getSign(A) == 0){							
-					if(getValue(A) > 0){										// (K) > +0
-						A = sub(A,2);
-					} else {													// (K) = +0	
-						Z += 2;	// 0100 (>> 1) 2
-						A = 0;
-					} 
-				} else {
-					if(getValue(A) > 0){										// (K) < -0
-						Z += 6;	// 0110 (>> 1) 3
-						A = sub(getValue(A),2);
-					} else {													// (K) = -0	
-						Z += 8; // 1000 (>> 1) 4
-						A = 0;
-					}
-				}
-				break;
-						
-			case TCF:
-				Z = sub(ADDR, 2);
-				break;
-				
-			case DAS:
-				unsetOverflow();
-				A = sum(A, loadWord(ADDR));										// (DDOUBL) DAS A
-				storeWord(ADDR, A);
-				L = sum(L, loadWord(ADDR+2));
-				storeWord(ADDR+2, L);
-				break;
-						
-			case LXCH:
-				if(ADDR == (7 << 1))											// (ZL) LXCH 7
-					L = ZR;
-				else{															// LXCH K
-					temp = loadWord(ADDR);
-					storeWord(ADDR, L);
-					L = temp;
-				}
-				break;
-						
-			case INCR:
-				storeWord(ADDR, sum(loadWord(ADDR), 2));
-				break;
-						
-			case ADS:
-				temp = loadWord(ADDR);
-				A = sum(A, temp);
-				storeWord(ADDR, A);
-				break;
-						
-			case CA:
-				if(ADDR == 0){													// CA A
-					// NOOP
-				}else{
-					unsetOverflow();
-					A = loadWord(ADDR);
-				}
-				break;
+	if(VERBOSE) cout << "\tADDR:\t" << (ADDR >> 1) << endl;
+	if(OPCODE > ALT || (OPCODE >= READ) != EXT)
+		throw NO_OPERAND;
+	if(EXT)
+		unsetExtended();
+	goto *dispatch[OPCODE];
+	
+	// STANDARD ISA
+	
+	op_XXALQ:	// TC A
+		Q = Z;
+		Z = 0xFFFE;	// Al termine del ciclo, (Z) = 65354 verrà incrementato e diventerà zero, facendo fetching nel primo registro.
+		goto done;
 				
-			case CS:
-				unsetOverflow();
-				if(ADDR == 0){
-					A = ~A;														// (COM) CS A
-					SIGN = (OW == 1) ? (~SIGN) : SIGN;
-					
-				}else{
-					A = ~loadWord(ADDR);										// CS K
-				}
-				break;
-
-			case RESUME:
-				A = ARUPT;
-				L = LRUPT;
-				Q = QRUPT;
-				BB = BBRUPT;
-				Z = ZRUPT;
-				unmaskInterrupt();
-				break;
-			
-			case INDEX:
-				setIndex();
-				B = loadWord(ADDR);
-				break;
-						
-			case DXCH:	// DXCH
-				if((ADDR >> 1) == 1){											// DXCH L
-					temp = Q;
-					Q = L; 
-					L = A;
-					A = temp;
-				} else if((ADDR >> 1) == 4){									// (DTCF) DXCH FB
-					temp = A;
-					A = FB; FB = temp;
-					temp = L;
-					L = Z; Z = temp;
-				} else if ((ADDR >> 1) == 5){									// (DTCB) DXCH Z
-					temp = A;
-					A = Z; Z = temp;
-					temp = L;
-					L = BB; BB = temp;
-				} else {														// DXCH K
-					temp = A;
-					A = loadWord(ADDR); 
-					storeWord(ADDR, temp);
-					temp = L;
-					L = loadWord(ADDR+2); 
-					storeWord(ADDR+2, temp);
-				}
-				break;
-						
-			case TS:															// TS
-				if(OW && ADDR == 0){										// (OVSK) TS A
-					Z += 2;
-				} else if((ADDR >> 1) == 5){								// (TCAA) TS Z
-					Z = A & 0x1FFE; 		// 0001 11..1 1110
-					if(OW){
-						if(SIGN)			// Positive ow
-							A = 0x0002; 	// +1 = 0000 00..0 0010
-						else				// Negative ow
-							A = 0xFFFC; 	// -1 = 1111 11..1 1100
-					Z += 2;
-					}
-				} else {													// TS K
-					if(OW){
-						storeWord(ADDR, SIGN | getValue(A));
-						if(SIGN)			// Positive ow
-							A = 0x0002; 	// +1 = 0000 00..0 0010
-						else				// Negative ow
-							A = 0xFFFC; 	// -1 = 1111 11..1 1100
-						Z += 2;
-					}else
-						storeWord(ADDR, A);
-
-				}
-				unsetOverflow();
-				break;
-					
-			case XCH:															// XCH
-				temp = A;
-				A = loadWord(ADDR); 
-				storeWord(ADDR, temp);
-				break;
+	op_XLQ:	// TC L
+		Q = Z;
+		Z = 0;
+		goto done;
 				
-			case AD:															// AD
-				if(ADDR == 0)													// (DOUBLE) AD A
-					A = sum(A, A);
-				else 
-					A = sum(A, loadWord(ADDR));
-				break;
+	op_RETURN:
+		Z = Q;
+		goto done;
 				
-			case MASK:															// MASK
-				A &= loadWord(ADDR);
-				break;
+	op_RELINT:
+		unmaskInterrupt();
+		goto done;
+	
+	op_INHINT:
+		maskInterrupt();
+		goto done;
+	
+	op_EXTEND:
+		setExtended();
+		goto done;
 			
-			default:
-				throw NO_OPERAND;
+	op_TC:
+		Q = Z;
+		Z = aluSub(ADDR, 2).value;
+		goto done;
 			
+	op_CCS:
+		unsetOverflow();
+		A = loadWord(ADDR);
+		if(getSign(A) == 0){							
+			if(getValue(A) > 0){										// (K) > +0
+				A = latch<VERBOSE>(aluSub(A, 2));
+			} else {													// (K) = +0	
+				Z += 2;	// 0100 (>> 1) 2
+				A = 0;
+			} 
+		} else {
+			if(getValue(A) > 0){										// (K) < -0
+				Z += 6;	// 0110 (>> 1) 3
+				A = latch<VERBOSE>(aluSub(getValue(A), 2));
+			} else {													// (K) = -0	
+				Z += 8; // 1000 (>> 1) 4
+				A = 0;
+			}
 		}
-		
-	} else {
-		
-		unsetExtended();
-		switch(OPCODE){
-		
-			case READ:	// READ
-				A = loadWordIO(ADDR);
-				break;
-			
-			case WRITE:	// WRITE
-				storeWordIO(ADDR, A);
-				break;
+		goto done;
 				
-			case RAND:	// RAND
-				A = A & loadWordIO(ADDR);
-				break;
-				
-			case WAND:	// WAND
-				A = A & loadWordIO(ADDR);
-				storeWordIO(ADDR, A);
-				break;
-				
-			case ROR:	// ROR
-				A = A | loadWordIO(ADDR);
-				break;
-				
-			case WOR:	// WOR
-				storeWordIO(ADDR, A | loadWordIO(ADDR));
-				break;
+	op_TCF:
+		Z = aluSub(ADDR, 2).value;
+		goto done;
+		
+	op_DAS:
+		unsetOverflow();
+		A = latch<VERBOSE>(aluAdd(A, loadWord(ADDR)));							// (DDOUBL) DAS A
+		storeWord(ADDR, A);
+		L = latch<VERBOSE>(aluAdd(L, loadWord(ADDR+2)));
+		storeWord(ADDR+2, L);
+		goto done;
 				
-			case RXOR:	// RXOR
-				A = A ^ loadWordIO(ADDR);
-				break;
+	op_LXCH:
+		if(ADDR == (7 << 1))											// (ZL) LXCH 7
+			L = ZR;
+		else{															// LXCH K
+			temp = loadWord(ADDR);
+			storeWord(ADDR, L);
+			L = temp;
+		}
+		goto done;
 				
-			case ALT: // ALT
-				throw ALT;
+	op_INCR:
+		storeWord(ADDR, latch<VERBOSE>(aluAdd(loadWord(ADDR), 2)));
+		goto done;
 				
-			case DV:
-				isEditing();
-				unsetOverflow();
-				div(loadWord(ADDR));	// controllare per eventuali ow
-				break;
-					
-			case BZF:
-				if(A == 0)
-					Z = sub(ADDR, 2);
-				break;
+	op_ADS:
+		temp = loadWord(ADDR);
+		A = latch<VERBOSE>(aluAdd(A, temp));
+		storeWord(ADDR, A);
+		goto done;
 				
-			case MSU:		// MSU
-				unsetOverflow();
-				A = reconv16((A >> 1) - (loadWord(ADDR) >> 1));		// Calcola la differenza tra due numeri in cmp2 e poi lo converte in cmp1
-				break;
+	op_CA:
+		if(ADDR == 0){													// CA A
+			// NOOP
+		}else{
+			unsetOverflow();
+			A = loadWord(ADDR);
+		}
+		goto done;
+		
+	op_CS:
+		unsetOverflow();
+		if(ADDR == 0){
+			A = ~A;														// (COM) CS A
+			SIGN = (OW == 1) ? (~SIGN) : SIGN;
 			
-			case QXCH:		// QXCH
-				if(ADDR == (7 << 1))														// (ZQ) QXCH 7
-					Q = ZR;
-				else{	
-					temp = loadWord(ADDR);
-					storeWord(ADDR, Q);
-					Q = temp;
-				}
-				break;
-				
-			case AUG:		// AUG
-				if(getSign(loadWord(ADDR)) == 0)
-					storeWord(ADDR, sum(loadWord(ADDR), 2) );
-				else
-					storeWord(ADDR, sub(loadWord(ADDR), 2) );
-				break;
-				
-			case DIM:		// DIM
-				if(getSign(loadWord(ADDR)) == 0 && getValue(loadWord(ADDR)) > 0)
-					storeWord(ADDR, sub(loadWord(ADDR), 2) );
-				else if (getSign(loadWord(ADDR)) == 1 && getValue(loadWord(ADDR)) > 0)
-					storeWord(ADDR, sum(loadWord(ADDR), 2) );
-				break;
-					
-			case DCA:		// DCA
-				unsetOverflow();
-				A = loadWord(ADDR);
-				L = loadWord(ADDR + 2);
-				break;
-				
-			case DCS:		// DCS
-				unsetOverflow();
-				if(ADDR == 0){													// (DCOM) DCS A
-					A = ~A;
-					L = ~L;
-				} else {
-					A = ~loadWord(ADDR);
-					L = ~loadWord(ADDR + 2);
-				}
-				break;
-				
-			case INDEX_EXT:	// INDEX
-				setExtended();
-				Z = sum(Z, sub(loadWord(ADDR), (1 << 1)));
-				break;
+		}else{
+			A = ~loadWord(ADDR);										// CS K
+		}
+		goto done;
+
+	op_RESUME:
+		A = ARUPT;
+		L = LRUPT;
+		Q = QRUPT;
+		BB = BBRUPT;
+		mapBanks();
+		Z = ZRUPT;
+		unmaskInterrupt();
+		goto done;
+	
+	op_INDEX:
+		setIndex();
+		B = loadWord(ADDR);
+		goto done;
 				
-			case SU:		// SU
-				A = sub(A,loadWord(ADDR));
-				break;
-					
-			case BZMF:		// BZMF
-				if(getSign(A) == 1)
-					Z = sub(loadWord(ADDR), (1 << 1));
-				break;
+	op_DXCH:	// DXCH
+		if((ADDR >> 1) == 1){											// DXCH L
+			temp = Q;
+			Q = L; 
+			L = A;
+			A = temp;
+		} else if((ADDR >> 1) == 4){									// (DTCF) DXCH FB
+			temp = A;
+			A = FB; FB = temp;
+			mapBanks();
+			temp = L;
+			L = Z; Z = temp;
+		} else if ((ADDR >> 1) == 5){									// (DTCB) DXCH Z
+			temp = A;
+			A = Z; Z = temp;
+			temp = L;
+			L = BB; BB = temp;
+			mapBanks();
+		} else {														// DXCH K
+			temp = A;
+			A = loadWord(ADDR); 
+			storeWord(ADDR, temp);
+			temp = L;
+			L = loadWord(ADDR+2); 
+			storeWord(ADDR+2, temp);
+		}
+		goto done;
 				
-			case MP:		// MP
-				isEditing();
-				unsetOverflow();
-				if(ADDR == 0)													// (SQUARE) MP 0	
-					mul(A, A);
-				else
-					mul(A, loadWord(ADDR));
-				break;
+	op_TS:	// TS
+		if(OW && ADDR == 0){										// (OVSK) TS A
+			Z += 2;
+		} else if((ADDR >> 1) == 5){								// (TCAA) TS Z
+			Z = A & 0x1FFE; 		// 0001 11..1 1110
+			if(OW){
+				if(SIGN)			// Positive ow
+					A = 0x0002; 	// +1 = 0000 00..0 0010
+				else				// Negative ow
+					A = 0xFFFC; 	// -1 = 1111 11..1 1100
+			Z += 2;
+			}
+		} else {													// TS K
+			if(OW){
+				storeWord(ADDR, SIGN | getValue(A));
+				if(SIGN)			// Positive ow
+					A = 0x0002; 	// +1 = 0000 00..0 0010
+				else				// Negative ow
+					A = 0xFFFC; 	// -1 = 1111 11..1 1100
+				Z += 2;
+			}else
+				storeWord(ADDR, A);
+
+		}
+		unsetOverflow();
+		goto done;
+			
+	op_XCH:	// XCH
+		temp = A;
+		A = loadWord(ADDR); 
+		storeWord(ADDR, temp);
+		goto done;
 		
-			default:
-				throw NO_OPERAND;
+	op_AD:	// AD
+		if(ADDR == 0)													// (DOUBLE) AD A
+			A = latch<VERBOSE>(aluAdd(A, A));
+		else 
+			A = latch<VERBOSE>(aluAdd(A, loadWord(ADDR)));
+		goto done;
+		
+	op_MASK:	// MASK
+		A &= loadWord(ADDR);
+		goto done;
+	
+	// EXTENDED ISA
+	
+	op_READ:	// READ
+		A = loadWordIO(ADDR);
+		goto done;
+	
+	op_WRITE:	// WRITE
+		storeWordIO(ADDR, A);
+		goto done;
+		
+	op_RAND:	// RAND
+		A = A & loadWordIO(ADDR);
+		goto done;
+		
+	op_WAND:	// WAND
+		A = A & loadWordIO(ADDR);
+		storeWordIO(ADDR, A);
+		goto done;
+		
+	op_ROR:	// ROR
+		A = A | loadWordIO(ADDR);
+		goto done;
+		
+	op_WOR:	// WOR
+		storeWordIO(ADDR, A | loadWordIO(ADDR));
+		goto done;
+		
+	op_RXOR:	// RXOR
+		A = A ^ loadWordIO(ADDR);
+		goto done;
+		
+	op_ALT:	// ALT
+		throw ALT;
+		
+	op_DV:
+		isEditing();
+		unsetOverflow();
+		temp = loadWord(ADDR);
+		if(aluDivByZero(temp))
+			throw NO_DIVISION;
+		latch<VERBOSE>(aluDiv(A, L, temp));	// controllare per eventuali ow
+		goto done;
 			
+	op_BZF:
+		if(A == 0)
+			Z = aluSub(ADDR, 2).value;
+		goto done;
+		
+	op_MSU:	// MSU
+		unsetOverflow();
+		A = fromInt15((A >> 1) - (loadWord(ADDR) >> 1));		// Calcola la differenza tra due numeri in cmp2 e poi lo converte in cmp1
+		goto done;
+	
+	op_QXCH:	// QXCH
+		if(ADDR == (7 << 1))														// (ZQ) QXCH 7
+			Q = ZR;
+		else{	
+			temp = loadWord(ADDR);
+			storeWord(ADDR, Q);
+			Q = temp;
 		}
+		goto done;
 		
-	}
-
+	op_AUG:	// AUG
+		if(getSign(loadWord(ADDR)) == 0)
+			storeWord(ADDR, latch<VERBOSE>(aluAdd(loadWord(ADDR), 2)));
+		else
+			storeWord(ADDR, latch<VERBOSE>(aluSub(loadWord(ADDR), 2)));
+		goto done;
+		
+	op_DIM:	// DIM
+		if(getSign(loadWord(ADDR)) == 0 && getValue(loadWord(ADDR)) > 0)
+			storeWord(ADDR, latch<VERBOSE>(aluSub(loadWord(ADDR), 2)));
+		else if (getSign(loadWord(ADDR)) == 1 && getValue(loadWord(ADDR)) > 0)
+			storeWord(ADDR, latch<VERBOSE>(aluAdd(loadWord(ADDR), 2)));
+		goto done;
+			
+	op_DCA:	// DCA
+		unsetOverflow();
+		A = loadWord(ADDR);
+		L = loadWord(ADDR + 2);
+		goto done;
+		
+	op_DCS:	// DCS
+		unsetOverflow();
+		if(ADDR == 0){													// (DCOM) DCS A
+			A = ~A;
+			L = ~L;
+		} else {
+			A = ~loadWord(ADDR);
+			L = ~loadWord(ADDR + 2);
+		}
+		goto done;
+		
+	op_INDEX_EXT:	// INDEX
+		setExtended();
+		Z = latch<VERBOSE>(aluAdd(Z, latch<VERBOSE>(aluSub(loadWord(ADDR), (1 << 1)))));
+		goto done;
+		
+	op_SU:	// SU
+		A = latch<VERBOSE>(aluSub(A, loadWord(ADDR)));
+		goto done;
+			
+	op_BZMF:	// BZMF
+		if(getSign(A) == 1)
+			Z = latch<VERBOSE>(aluSub(loadWord(ADDR), (1 << 1)));
+		goto done;
+		
+	op_MP:	// MP
+		isEditing();
+		unsetOverflow();
+		if(ADDR == 0)													// (SQUARE) MP 0	
+			latch<VERBOSE>(aluMul(A, A));
+		else
+			latch<VERBOSE>(aluMul(A, loadWord(ADDR)));
+		goto done;
+	
+	done:
 	return 0;
 	
 }
@@ -1232,10 +2255,11 @@ void agc::subroutine(){
 	
 }
 
+template<bool VERBOSE>
 void agc::interrupt(){
 	
 	if(INX == false && OW == false && EXT == false && MASKINTR == false && INTR == true){
-		if(verbose) {
+		if(VERBOSE) {
 			cout << "RAM[600]: " << (RAM[600] >> 1) << endl;
 			cout << "RAM[601]: " << (RAM[601] >> 1) << endl;
 			cout << "RAM[602]: " << (RAM[602] >> 1) << endl;
@@ -1244,7 +2268,8 @@ void agc::interrupt(){
 			cout << "stato: " << (RAM[605] >> 1) << endl;
 		}
 		loadIRegisters();
-		loadInterrupt();
+		loadInterrupt<VERBOSE>();
+		watchHit |= watchInterrupt;
 		Z -= 2;				// Questa operazione, assieme al successivo incremento, rende invariato il registro Z
 		
 	}
@@ -1261,36 +2286,124 @@ void agc::specialroutine(){
 }
 
 int agc::emulate(){
+	return emulate(ULONG_MAX);
+}
+
+int agc::emulate(long unsigned mct, int z){
 	
-	while(!DSKYReady);
+	// Until a viewer connects: a stop asked meanwhile (SIGINT) ends the wait
+	while(!DSKYReady && !options.headless){
+		if(requests.load() & REQUEST_STOP){
+			requests.fetch_and(~REQUEST_STOP);
+			stopReason = STOP_REQUEST;
+			return NO_FAULT;
+		}
+		usleep(10000);
+	}
 	
-	cout << "Emulation started.\n\n";
+	if(options.aotEngine && !loadCompiledBlocks())
+		cerr << "No compiled blocks for this ROM (build with \"make aot\").\n";
+	
+	if(!options.headless)
+		cout << "Emulation started.\n\n";
+	
+	stopMCT = mct;
+	stopZ = z;
+	
+	if(historyDepth){
+		// Running again after travel(): what was recorded after now is another future
+		if(steps == nextInput)
+			pressRecorded();
+		while(!history.empty() && ((const agcCheckpoint*) history.back().data())->steps > steps)
+			history.pop_back();
+		while(!inputs.empty() && inputs.back().steps > steps)
+			inputs.pop_back();
+		nextInput = ULONG_MAX;
+		nextHistory = MCT;
+		nextEvent = MCT;
+	}
+	
+	// Inputs queued while stopped are taken before the first instruction
+	if(MCT >= nextEvent)
+		timedEvents();
+	if(requests.load(memory_order_relaxed) && serveRequests()){
+		stopReason = STOP_REQUEST;
+		return NO_FAULT;
+	}
+	
+	// The options never change while running: pick the specialized loop once
+	bool pacing = options.pacing;
+	if(options.verbose){
+		if(options.boundsChecks)
+			return pacing ? emulateLoop<true, true, true>() : emulateLoop<true, true, false>();
+		return pacing ? emulateLoop<true, false, true>() : emulateLoop<true, false, false>();
+	}
+	if(options.boundsChecks)
+		return pacing ? emulateLoop<false, true, true>() : emulateLoop<false, true, false>();
+	return pacing ? emulateLoop<false, false, true>() : emulateLoop<false, false, false>();
+	
+}
+
+template<bool VERBOSE, bool CHECKED, bool PACED>
+int agc::emulateLoop(){
 	
-	if(verbose)
+	if(VERBOSE)
 		debug();
 		
 	for(;;){
-		if(verbose) cout << "Z: " << (Z >> 1) << endl;
+		if(VERBOSE) cout << "Z: " << (Z >> 1) << endl;
 		try{
-			fetch(Z);
-			decode(S);
-			exec();
-			subroutine();
-			interrupt();
-			specialroutine();
+			aotBlock native = NULL;
+			agcBlock *block = NULL;
+			if(!VERBOSE && !INX){//an indexed word is run by the interpreter
+				if(options.aotEngine)
+					native = compiled(Z);
+				if(!native && options.blockEngine)
+					block = translate<CHECKED>(Z);
+			}
+			if(native)
+				native(*this);
+			else if(block)
+				execBlock(*block);
+			else{
+				if(VERBOSE){
+					fetch(Z);
+					decode<true, CHECKED>(S);
+				}else
+					predecode<CHECKED>(Z);
+				exec<VERBOSE>();
+				subroutine();
+				interrupt<VERBOSE>();
+				specialroutine();
+				steps++;
+			}
 		}catch(int e){
 			exceptions(e);
+			stopReason = STOP_FAULT;
+			return e;
 		}
 		
-		slow_down();
+		if(PACED && MCT >= nextQuantum)
+			slow_down();
 		
-		dsky.toggleBlinker();
-		dsky.clearStrobes();
+		dsky.toggleBlinker(MCT);
+		dsky.clearStrobes(MCT);
+		
+		if(MCT >= nextEvent)
+			timedEvents();
+		
+		if(requests.load(memory_order_relaxed) && serveRequests()){
+			stopReason = STOP_REQUEST;
+			return NO_FAULT;
+		}
+		
+		if(MCT >= stopMCT || (Z >> 1) == stopZ){
+			stopReason = ((Z >> 1) == stopZ) ? STOP_Z : STOP_MCT;
+			return NO_FAULT;
+		}
 		
 	}
 	
-	return 0;
-	
 }
 
 void agc::simulation(){
@@ -1301,11 +2414,11 @@ void agc::simulation(){
 	try{
 		
 		fetch(Z);
-		decode(S);
-		exec();
+		decode<true, true>(S);
+		exec<true>();
 		if(INTR){
 			loadIRegisters();
-			loadInterrupt();
+			loadInterrupt<true>();
 		}
 
 		debug();
@@ -1314,11 +2427,11 @@ void agc::simulation(){
 			Z += 2;
 			
 			fetch(Z);
-			decode(S);
-			exec();
+			decode<true, true>(S);
+			exec<true>();
 			if(INTR){
 				loadIRegisters();
-				loadInterrupt();
+				loadInterrupt<true>();
 			}
 			
 			debug();
@@ -1327,7 +2440,14 @@ void agc::simulation(){
 	}catch(int e){
 		
 		exceptions(e);
+		cout << "\tEXCEPTION: " << exceptionName(e);
+		debug();
 		
 	}
 	
-}
\ No newline at end of file
+}
+// Used by agc-translate
+template agcBlock* agc::translate<true>(uint16_t addr);
+// Used by the compiled blocks
+template uint16_t agc::latch<false>(aluWord r);
+template void agc::latch<false>(aluDouble r);
@@ -10,26 +10,151 @@
 #include <iostream>
 #include <cstdint>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <bitset>
 #include <string.h>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <climits>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "agcConstants.h"
 #include "dskyConstants.h"
 #include "DSKYLogic.h"
+#include "alu.h"
+#include "checkpointLog.h"
+#include "spscQueue.h"
 
 using namespace std;
 using namespace chrono;
 
-extern bool verbose;
+/* configuration of a single machine (command line options in main.cc) */
+struct agcOptions {
+	bool verbose = false;
+	bool blockEngine = false;		// run fixed memory through the block engine
+	bool aotEngine = false;			// run the blocks compiled by agc-translate
+	bool boundsChecks = true;		// address checks of decode
+	bool pacing = true;				// pace the emulation to the host clock
+	double speed = 1;				// speed factor of the virtual clock
+	long unsigned quantum = PACING_QUANTUM;	// MCT run between two waits of the host clock
+	bool headless = false;			// no GUI: do not wait for the DSKY page
+	string snapshot = "agc.snap";	// written when a snapshot is requested
+};
+
+/* machine state on file (host byte order): fixed size types only, so a file can be mapped as it is */
+struct agcSnapshot {
+	char magic[8];				// SNAPSHOT_MAGIC
+	uint32_t version;			// SNAPSHOT_VERSION
+	uint32_t size;				// sizeof(agcSnapshot)
+	uint64_t MCT;
+	uint64_t T4INC;
+	uint16_t RAM[RAMSIZE];
+	uint16_t ROM[ROMSIZE];
+	uint16_t IO[IOSIZE];
+	uint16_t OPCODE;
+	uint16_t ADDR;
+	uint16_t INT_TYPE;
+	uint16_t SIGN;
+	uint16_t S;
+	uint16_t B;
+	uint8_t MASKINTR;
+	uint8_t INTR;
+	uint8_t EXT;
+	uint8_t OW;
+	uint8_t INX;
+	uint8_t reserved[7];
+	dskySnapshot dsky;
+};
+
+/* head of a checkpoint log */
+struct checkpointHeader {
+	char magic[8];				// CHECKPOINT_MAGIC
+	uint32_t version;			// CHECKPOINT_VERSION
+	uint32_t size;				// sizeof(agcCheckpoint)
+};
+
+/* a checkpoint of the log, followed by 256 words for each bit set in pages */
+struct agcCheckpoint {
+	uint32_t size;				// bytes, pages included
+	uint32_t pages;				// pages changed since the previous checkpoint (all in the first one)
+	uint64_t steps;				// instructions run
+	uint64_t MCT;
+	uint64_t T4INC;
+	uint16_t OPCODE;
+	uint16_t ADDR;
+	uint16_t INT_TYPE;
+	uint16_t SIGN;
+	uint16_t S;
+	uint16_t B;
+	uint8_t MASKINTR;
+	uint8_t INTR;
+	uint8_t EXT;
+	uint8_t OW;
+	uint8_t INX;
+	uint8_t reserved[3];
+	dskySnapshot dsky;
+};
+
+/* external input, taken by the CPU between two instructions */
+struct agcInput {
+	uint64_t mct;				// MCT when it was taken
+	uint64_t steps;				// instructions run then
+	uint16_t kind;				// INPUT_KEY, INPUT_PRO
+	uint16_t value;
+	uint32_t gap;				// queued keys: MCT to wait after the previous key was taken
+};
+
+class agc;
+
+/* block compiled ahead of time by agc-translate */
+typedef void (*aotBlock)(agc &m);
+
+struct aotEntry {
+	uint16_t addr;				// fixed-fixed address of the first word
+	bool ext;					// EXT state at the block entry
+	aotBlock run;
+};
+
+int aotRegister(const aotEntry *table, int size, uint32_t checksum);	/* called by the generated unit */
+
+/* result of decode() for a single word, cached by physical address */
+struct decodedWord {
+	uint16_t word;				// S
+	uint16_t addr;				// ADDR (meaningful only for opcodes after EXTEND)
+	uint8_t opcode;				// OPCODE
+	uint8_t mct;				// cost added by decode()
+	int8_t exception;			// exception thrown by decode(), -1 if none
+	bool valid;
+};
+
+/* straight-line code in fixed-fixed memory, run without decoding */
+struct agcBlock {
+	vector<decodedWord> code;	// last word is the one that may leave the block
+	bool valid;					// translated (code may be empty if untranslatable)
+};
 
 class agc {
 	
+	friend struct aotBlocks;		// generated by agc-translate
+	
 private:
 	
+	agcOptions options;
+	int fault;					// exception that stopped the machine, NO_FAULT while running
+	
 	// GUI
-	bool DSKYReady;
+	atomic<bool> DSKYReady;		// set by the GUI thread
+	atomic<int> requests;		// REQUEST_ bits set by other threads, served by the CPU
 	DSKYLogic dsky;
 	
 	// Work registers
@@ -49,15 +174,63 @@ private:
 	
 	// Main structures
 	uint16_t RAM[RAMSIZE];
-	uint16_t ROM[ROMSIZE];
+	uint16_t *ROM;								// romData, read-only while shared
+	shared_ptr<vector<uint16_t> > romData;		// shared by clones until one of them writes
 	uint16_t IO[IOSIZE];
 	uint16_t& FEB = IO[7];
 	uint16_t SIGN;
 	
+	// Address translation: a pointer per 256 words of the 4096-word address space
+	uint16_t *pageTable[16];
+	
+	// Predecoded instructions: [EXT][physical address], mapped zero (invalid) on demand
+	decodedWord (*decodeCache)[DECODE_CACHE_SIZE];
+	
+	// Translated blocks: [EXT][fixed-fixed address - 2048], allocated by the first translate()
+	agcBlock (*blockCache)[2048];
+	
+	// Compiled blocks: [EXT][fixed-fixed address - 2048]
+	aotBlock compiledCode[2][2048];
+	
 	// SIMULATE TIME
 	long unsigned MCT;			// Durata dell'istruzione: 1 MCT = 12 us
 	long unsigned T4INC;
-	time_point<steady_clock> time_zero;
+	struct timespec time_zero;	// CLOCK_MONOTONIC time of MCT 0
+	long unsigned nextQuantum;	// MCT at which the CPU waits for the host clock
+	long unsigned stopMCT;		// emulate() returns once MCT reaches it...
+	int stopZ;					// ...or Z reaches this address (-1 for none)
+	int stopReason;				// STOP_ of the last return of emulate()
+	
+	// Checkpoints
+	checkpointLog *checkpoints;	// NULL when not logging
+	uint32_t dirtyPages;		// bit per 256 words written since the last checkpoint, see CHECKPOINT_PAGES
+	long unsigned checkpointPeriod;
+	long unsigned nextLog;		// MCT of the next checkpoint on file, ULONG_MAX when not logging
+	long unsigned nextEvent;	// the first of nextLog, nextHistory and nextReplay
+	
+	// Time travel
+	long unsigned steps;		// instructions run
+	deque<vector<char> > history;	// full checkpoints in memory, the oldest first
+	size_t historyDepth;		// checkpoints kept, 0 when not recording
+	long unsigned nextHistory;	// MCT of the next one, ULONG_MAX when not recording
+	deque<agcInput> inputs;		// inputs taken since the oldest checkpoint
+	long unsigned nextInput;	// step of the next one to take again, ULONG_MAX for none
+	int watchIndex;				// erasable word watched by lastWrite(), -1 for none
+	bool watchInterrupt;		// watched by lastInterrupt()
+	bool watchHit;				// set when the watched event happens
+	
+	// State hash
+	uint64_t memoryHash;		// words above 255 of erasable and IO, kept by storeWord and storeWordIO
+	
+	// Inputs
+	spscQueue<agcInput, INPUT_QUEUE_SIZE> pending;	// queued by other threads (mct and steps not set yet), taken by the CPU
+	mutex inputLock;			// one producer at a time on pending, never taken by the CPU
+	uint64_t queuedInputs;		// inputs ever pushed on pending, under inputLock
+	atomic<uint64_t> takenInputs;	// of them, taken by the CPU
+	long unsigned keyMCT;		// MCT the last key was taken at
+	ofstream inputRecord;		// every input taken, when recording
+	deque<agcInput> replay;		// inputs to take again at their MCT
+	long unsigned nextReplay;	// MCT of the first one, ULONG_MAX for none
 
 	uint16_t S;					// Registro non accessibile allo sviluppatore usato per controllare l'address (se è su 16 o 12 bit) ed accedere alla memoria
 	uint16_t B;					// Usato per alcune operazioni e index opcode
@@ -99,13 +272,34 @@ private:
 	
 	/* manage timing */
 	void setMCT(uint16_t value);
-	void slow_down();
+	void slow_down();			/* wait the host clock at the end of a quantum */
+	void resetClock();			/* the current MCT is due now */
+	
+	/* state other than the memories, shared by snapshots and checkpoints */
+	template<class STATE> void saveState(STATE &state);
+	template<class STATE> void loadState(const STATE &state);
+	void copyState(const agc &source, const agcOptions &options);	/* what a clone takes from source, the caches apart */
+	void fillCheckpoint(vector<char> &record, uint32_t pages);	/* registers and the pages in a record */
+	void applyCheckpoint(const agcCheckpoint &state);			/* the reverse, caches left as they are */
+	
+	/* time travel */
+	void pressRecorded();				/* the recorded inputs of the current step */
+	bool replayTo(long unsigned target);	/* from the last checkpoint in memory before target, false if past a fault */
+	bool findBack();					/* back to just after the last step that set watchHit */
 	
 public:
 	
-	agc();
+	agc(const agcOptions &options = agcOptions());
+	agc(const agc &source);							/* clone: ROM is shared until written */
+	agc(const agc &source, const agcOptions &options);	/* clone running with other options */
+	~agc();
+	void reset(const agc &source);					/* a clone of source again, reusing the memory of this one */
+	void reset(const agc &source, const agcOptions &options);
+	void setOptions(const agcOptions &options);		/* between two emulate() */
 	
-	int emulate();
+	int emulate();				/* runs until a fault, returns it */
+	int emulate(long unsigned mct, int z = -1);	/* same, but also stops at MCT mct or address z (returns NO_FAULT) */
+	template<bool VERBOSE, bool CHECKED, bool PACED> int emulateLoop();	/* emulate() specialized on the options */
 	void simulation();
 	
 	/* bios and programs */
@@ -120,16 +314,41 @@ public:
 	void storeWordIO(uint16_t addr, uint16_t value);/* store a word in the main memory */
 	uint16_t loadWord(uint16_t addr);				/* load a word from main memory */
 	void storeWord(uint16_t addr, uint16_t value);	/* store a word in the main memory */
+	void mapBanks();								/* rebuild pageTable after EB, FB, BB or FEB change */
+	bool loadImage(const char *path, bool erasable);/* raw words (memory format) over ROM or erasable from address 0 */
+	void writableROM();								/* stop sharing ROM before writing it */
+	
+	/* snapshots */
+	bool saveSnapshot(const char *path);
+	bool loadSnapshot(const char *path);			/* false if missing or not a snapshot of this version */
+	void requestSnapshot();							/* async-signal-safe: options.snapshot is saved after the current instruction */
+	void requestStop();								/* async-signal-safe: emulate() returns after the current instruction */
+	
+	/* checkpoints: only the pages written since the previous one */
+	bool startCheckpoints(const char *path, long unsigned period = CHECKPOINT_PERIOD);	/* new log, first checkpoint at the next instruction */
+	void stopCheckpoints();							/* waits until the queued ones are on file */
+	void timedEvents();								/* checkpoints and replayed inputs due at this MCT */
+	bool serveRequests();							/* snapshot, inputs and stop asked by other threads: true to stop */
+	bool loadCheckpoint(const char *path, long unsigned mct);	/* state of the last checkpoint at or before mct */
+	
+	/* time travel: checkpoints in memory, and the steps in between run again */
+	void startHistory(long unsigned seconds);		/* keep the last seconds of mission time, the interpreter only */
+	int step();										/* one instruction through the interpreter, returns the fault */
+	long unsigned getSteps();
+	bool travel(long unsigned target);				/* state after target instructions, false if out of the history */
+	bool stepBack(long unsigned n);
+	bool lastWrite(uint16_t addr);					/* just after the last store into erasable addr (not in memory format) */
+	bool lastInterrupt();							/* just after the last interrupt was taken */
 	bool getSign(uint16_t value);					/* get sign from value */
 	uint16_t getValue(uint16_t value);				/* get value removing sign */
 	
 	/* interrupt */
 	void loadIDTR();
 	void loadIRegisters();
-	void loadInterrupt();
+	template<bool VERBOSE> void loadInterrupt();
 	void loadINT16();
 	void loadINT20();
-	void interrupt();
+	template<bool VERBOSE> void interrupt();
 	void rupt();						/* interrupt return */
 	
 	/* flags */
@@ -151,33 +370,64 @@ public:
 	void isEditing();					/* is an editing register? */
 	void handlerFixedMemAddress();		/* check if addr is a fixed addr */
 	void debug();						/* do machine diagnostics */
+	void debugDiff(agc &other);		/* words and registers that differ from other */
+	uint64_t stateHash();				/* hash of erasable, IO, registers, flags, MCT, steps and DSKY (not ROM) */
+	void rehash();						/* memoryHash from scratch, after bulk changes of the memories */
 	void exceptions(int e);				/* manage exceptions and random behaviours */
+	int getFault();
+	int getStopReason();			/* STOP_FAULT, STOP_MCT, STOP_Z or STOP_REQUEST: why emulate() returned */
+	static const char* exceptionName(int e);
 	
 	/* start execution using emulation */
 	void fetch(uint16_t word);			/* fetches the next word and writes it in S register */
-	void decode(uint16_t word);			/* decode the OPCODE and the ADDRESS in the respective variables */
-	int exec();							/* execution of istruction */
+	template<bool VERBOSE, bool CHECKED> void decode(uint16_t word);	/* decode the OPCODE and the ADDRESS in the respective variables */
+	template<bool CHECKED> void predecode(uint16_t addr);	/* fetch and decode through the decode cache */
+	int physicalAddress(uint16_t addr);	/* index in the decode cache, -1 if not cacheable */
+	void invalidateDecode(int index);	/* drop cached decodes of a physical address */
+	void clearDecodeCache();
+	void allocateCaches();				/* empty decode and block caches of a new machine */
+	template<bool CHECKED> void decodeEntry(uint16_t word, decodedWord &entry);	/* decode a word into a cache entry */
+	
+	/* block engine */
+	bool endsBlock(const decodedWord &op);	/* may the word change Z, FB or the interrupt state? */
+	template<bool CHECKED = true> agcBlock* translate(uint16_t addr);	/* block starting at addr, NULL if it must be interpreted */
+	void execBlock(const agcBlock &block);	/* run a block, up to the first word after which the emulate loop has work */
+	bool blockStep();						/* end of a word inside a block, false to leave it */
+	void blockExit();						/* end of the last word of a block */
+	void clearBlockCache();
+	
+	/* compiled blocks */
+	uint32_t romChecksum();
+	bool loadCompiledBlocks();				/* false if none was linked for this ROM */
+	aotBlock compiled(uint16_t addr);		/* compiled block starting at addr, NULL if none */
+	template<bool VERBOSE> int exec();	/* execution of istruction */
 	void subroutine();					/* manage execution of timers and others components, etc. */
 	void specialroutine();				/* default instructions at each execution */
 
-	/* conversions: used to convert number from 1's cmp to 2's cmp and make calculations and viceversa */
-	int16_t conv16(uint16_t a);
-	uint16_t reconv16(int16_t a);
-	int32_t conv32(uint32_t a);
-	uint32_t reconv32(int32_t a);
+	/* calculations: latch the overflow of an ALU result into OW/SIGN; VERBOSE traces it (compiled blocks are quiet) */
+	template<bool VERBOSE = false> uint16_t latch(aluWord r);
+	template<bool VERBOSE = false> void latch(aluDouble r);	/* also loads A and L */
 	
-	/* calculations  */
-	uint16_t sum(uint16_t a, uint16_t b);
-	uint16_t sub(uint16_t a, uint16_t b);
-	void mul(uint16_t a, uint16_t b);
-	void div(uint16_t a);
+	/* inputs: other threads queue them, the CPU takes them between two instructions */
+	bool queueInput(uint16_t kind, uint16_t value);	/* false when the queue is full */
+	uint64_t queueKeys(const uint16_t *keys, size_t count, uint32_t gap);	/* all of them or none: ticket of the last one, 0 when the queue has no room */
+	bool inputTaken(uint64_t ticket);				/* from any thread: the input of ticket, and every one before it, was taken */
+	void takeInput(agcInput &input);				/* records it (time travel, inputRecord) and applies it */
+	void applyInput(const agcInput &input);
+	bool recordInputs(const char *path);			/* write every input taken to path, with its MCT */
+	void stopRecording();
+	bool replayInputs(const char *path, long unsigned &end);	/* take the inputs of path at their MCT; end: MCT the recording stopped at */
 	
 	/* dsky */
-	void dskyInput(uint16_t key);
-	string getDSKYStatus();
+	bool dskyInput(uint16_t key);
+	string getDSKYStatus();				/* safe from any thread, as getDSKYFrame() */
+	uint64_t getDSKYFrame(dskyFrame &frame);	/* the last display published by the CPU and its version */
+	int watchDSKY();					/* eventfd readable after every new frame, never closed (see DSKYLogic::watch) */
+	string getRegisters();				/* registers printed by debug(), as JSON */
+	long unsigned getMCT();
 	void run();
-	void resetProBit();
-	void setProBit();
+	bool resetProBit();								/* false when the input queue is full */
+	bool setProBit();
 	
 	/* basic trial software */
 	void prog1();
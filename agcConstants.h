@@ -57,6 +57,11 @@
 #define ROMSIZE 	36 * 1024
 #define IOSIZE 		512
 
+// DECODE CACHE
+#define DECODE_CACHE_SIZE	(ROMSIZE + RAMSIZE)	// ROM words first, then erasable words
+#define DECODE_FIRST_CACHED	48					// 0-057 are registers written outside storeWord(), never cached
+#define BLOCK_MAX			64					// words per translated block
+
 // RANGE VALUES
 #define INT15_MIN	-16383
 #define INT15_MAX	+16383
@@ -77,6 +82,7 @@
 #define HANDRUPT	1
 
 // EXCEPTIONS
+#define NO_FAULT					-1
 #define ACCESS_IN_IO_MEMORY			0
 #define ACCESS_IN_ERASABLE_MEMORY	1
 #define ACCESS_IN_FIXED_MEMORY		2
@@ -85,6 +91,40 @@
 #define NO_OPERAND					5
 #define USED_EDITING_REGISTER		6
 
+// WHY EMULATE() RETURNED
+#define STOP_FAULT		0	// an exception, returned
+#define STOP_MCT		1	// MCT reached the limit
+#define STOP_Z			2	// Z reached the address (also when MCT reached the limit at once)
+#define STOP_REQUEST	3	// requestStop()
+
+// SNAPSHOTS
+#define SNAPSHOT_MAGIC		"AGCSNAP"
+#define SNAPSHOT_VERSION	1
+
+// CHECKPOINTS
+#define CHECKPOINT_MAGIC	"AGCCKPT"
+#define CHECKPOINT_VERSION	2
+#define CHECKPOINT_PERIOD	(250000 / CYCLE_PERIOD)	// 250ms of mission time
+#define CHECKPOINT_PAGES	10							// erasable banks 0-7, then IO 0-255 and 256-511
+#define CHECKPOINT_ALWAYS	(1 | (1 << 8))				// bank 0 and IO 0-255 change without storeWord
+
+// INPUTS
+#define INPUT_KEY			0	// value: key code
+#define INPUT_PRO			1	// value: PRO bit
+#define INPUT_MAGIC			"# agc inputs: MCT kind value"
+#define INPUT_QUEUE_SIZE	64	// inputs queued by other threads and not taken yet, a power of two
+#define INT_KEYRUPT			(20 << 1)	// INT_TYPE of a key
+
+// REQUESTS from other threads, served by the CPU between two instructions
+#define REQUEST_SNAPSHOT	1
+#define REQUEST_INPUT		2
+#define REQUEST_STOP		4
+
+// TIME TRAVEL
+#define HISTORY_PERIOD		(1000000 / CYCLE_PERIOD)	// a checkpoint kept in memory every second of mission time
+
 // TIME
 #define CYCLE_PERIOD 12 //in microseconds
 #define TIMER4_PERIOD (10000 / 12) // 10ms
+#define PACING_QUANTUM (1000 / 12) // 1ms, MCT run between two waits of the host clock
+#define PACING_MAX_LAG 100000 // us behind the host clock before pacing gives up catching up
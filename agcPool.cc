@@ -0,0 +1,62 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#include "agcPool.h"
+
+agcPool::agcPool(const agc &source, size_t size) : base(source) {
+	this->size = size;
+	stopping = false;
+	filler = thread(&agcPool::fill, this);
+}
+
+agcPool::~agcPool(){
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	filler.join();
+	for(size_t i=0; i<ready.size(); i++){
+		delete ready[i];
+	}
+}
+
+void agcPool::fill(){
+	unique_lock<mutex> guard(lock);
+	for(;;){
+		wake.wait(guard, [this]{ return stopping || ready.size() < size; });
+		if(stopping)
+			return;
+		// Cloning only reads base: no need to hold the lock
+		guard.unlock();
+		agc *clone = new agc(base);
+		guard.lock();
+		ready.push_back(clone);
+	}
+}
+
+agc* agcPool::acquire(const agcOptions &options){
+	agc *clone = NULL;
+	{
+		lock_guard<mutex> guard(lock);
+		if(!ready.empty()){
+			clone = ready.front();
+			ready.pop_front();
+		}
+	}
+	wake.notify_one();
+	if(clone == NULL)//drained faster than the filler: clone here
+		clone = new agc(base);
+	clone->setOptions(options);
+	return clone;
+}
+
+void agcPool::release(agc *m){
+	// A reset costs a copy of erasable and IO, as a clone, without the allocations
+	m->reset(base);
+	lock_guard<mutex> guard(lock);
+	ready.push_back(m);
+}
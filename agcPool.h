@@ -0,0 +1,37 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "agc.h"
+
+using namespace std;
+
+/* clones of one machine state, made ahead of time by a background thread; machines given back are reset and handed out again */
+class agcPool
+{
+private:
+	agc base;					// never run, only cloned
+	size_t size;				// clones kept ready
+	deque<agc*> ready;
+	mutex lock;
+	condition_variable wake;
+	bool stopping;
+	thread filler;
+	
+	void fill();
+
+public:
+	agcPool(const agc &source, size_t size);
+	~agcPool();
+	agc* acquire(const agcOptions &options);	/* a machine in the state of source, running with options: release() or delete it */
+	void release(agc *m);		/* reset to source and kept for the next acquire() */
+};
@@ -0,0 +1,132 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "agcConstants.h"
+
+/*
+ *	1's complement arithmetic kernels.
+ *	Words are in memory format: SDDDDDDDDDDDDDDP (sign, 14 data bits, parity).
+ *	Every kernel is branchless and has no side effects: overflow (and, for double
+ *	results, the sign of the overflowed result) is returned with the value, the
+ *	caller latches it into OW/SIGN (see agc::latch).
+ */
+
+struct aluWord{
+	uint16_t value;
+	bool overflow;		// SIGN is latched from A, see agc::latch
+};
+
+struct aluDouble{
+	uint16_t A;			// upper word
+	uint16_t L;			// lower word
+	uint16_t sign;		// 0x8000 if the overflow is negative
+	bool overflow;
+};
+
+/* 1's cmp word -> 2's cmp */
+static inline int16_t toInt15(uint16_t a){
+
+	uint16_t sign = a & 0x8000;
+	return (int16_t) (((a >> 1) + (sign >> 15)) | sign);
+
+}
+
+/* 2's cmp -> 1's cmp word */
+static inline uint16_t fromInt15(int16_t a){
+
+	uint16_t u = (uint16_t) a;
+	return (uint16_t) ((u << 1) - ((u >> 14) & 2));
+
+}
+
+/* 1's cmp double word (A, L) -> 2's cmp */
+static inline int32_t toInt29(uint16_t hi, uint16_t lo){
+
+	uint32_t a = (((uint32_t) hi) << 16) | lo;
+	uint32_t sign = a & 0x80000000;
+
+	a = a >> 1;
+	uint32_t aA = ((a & 0x7FFF0000) >> 2) | sign | (sign >> 1) | (sign >> 2);		// SSSSDDDDDDDDDDDDDD00000000000000
+	uint32_t aL = (a & 0x00003FFF);													// 000000000000000000DDDDDDDDDDDDDD
+
+	return (int32_t) ((aA | aL) + (sign >> 31));
+
+}
+
+/* 2's cmp -> 1's cmp double word, overflow left clear */
+static inline aluDouble fromInt29(int32_t a){
+
+	uint32_t u = (uint32_t) a;
+	uint16_t sign = (u & 0x80000000) >> 16;
+	u = (u << 1) - (sign >> 14);
+
+	aluDouble r;
+	r.L = (u & 0x00007FFE) | sign;
+	r.A = ((u >> 14) & 0x00007FFE) | sign;
+	r.sign = 0;
+	r.overflow = false;
+	return r;
+
+}
+
+/* single precision: overflow only in the direction of b, with the sign of a */
+static inline aluWord aluAdd(uint16_t a, uint16_t b){
+
+	int32_t bs = toInt15(b);
+	int32_t s = toInt15(a) + bs;
+	aluWord r;
+	r.value = fromInt15(s);
+	r.overflow = ((s > INT15_MAX) & (bs > 0)) | ((s < INT15_MIN) & (bs < 0));
+	return r;
+
+}
+
+static inline aluWord aluSub(uint16_t a, uint16_t b){
+
+	int32_t bs = toInt15(b);
+	int32_t s = toInt15(a) - bs;
+	aluWord r;
+	r.value = fromInt15(s);
+	r.overflow = ((s > INT15_MAX) & (bs < 0)) | ((s < INT15_MIN) & (bs > 0));
+	return r;
+
+}
+
+/* MP: single x single -> double */
+static inline aluDouble aluMul(uint16_t a, uint16_t b){
+
+	int32_t p = (int32_t) toInt15(a) * (int32_t) toInt15(b);
+	aluDouble r = fromInt29(p);
+	r.sign = (a ^ b) & 0x8000;
+	r.overflow = (uint32_t) (p - INT29_MIN) > (uint32_t) (INT29_MAX - INT29_MIN);
+	return r;
+
+}
+
+/* DV: double (hi, lo) / single -> quotient in A, remainder in L. b must not be +0 */
+static inline aluDouble aluDiv(uint16_t hi, uint16_t lo, uint16_t b){
+
+	int32_t as = toInt29(hi, lo);
+	int32_t bs = toInt15(b);
+
+	int32_t quotient = as / bs;
+	int32_t remainder = (as % bs) & 0x0000EFFF;
+
+	aluDouble r = fromInt29((int32_t) (((uint32_t) quotient << 14) | remainder));
+	r.sign = 0;				// as the old div()
+	r.overflow = (as == INT29_MIN) & (bs == -1);
+	return r;
+
+}
+
+/* divisor that converts to 0 (+0 with or without parity) */
+static inline bool aluDivByZero(uint16_t b){
+	return (b >> 1) == 0;
+}
@@ -0,0 +1,143 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "assetCache.h"
+
+using namespace std;
+
+struct assetFile {
+	const char *path;			// of the request
+	const char *file;			// in the working directory
+	const char *type;
+};
+
+static const assetFile assetFiles[] = {
+	{"/index.html", "index.html", "text/html"},
+};
+
+static const size_t ASSET_COUNT = sizeof(assetFiles) / sizeof(assetFiles[0]);
+
+static bool readFile(const char *path, string &data, struct stat &info){
+	ifstream file(path, ios::binary);
+	if(!file || stat(path, &info) < 0)
+		return false;
+	stringstream buffer;
+	buffer << file.rdbuf();
+	data = buffer.str();
+	return true;
+}
+
+static string fileTag(const string &data){
+	//FNV-1a: the tag changes with the content, not with the process
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for(size_t i=0; i<data.size(); i++){
+		hash ^= (uint8_t)data[i];
+		hash *= 0x100000001B3ULL;
+	}
+	stringstream tag;
+	tag << hex << hash;
+	return tag.str();
+}
+
+assetCache::assetCache(){
+	assets = new shared_ptr<const staticAsset>[ASSET_COUNT];
+	for(size_t i=0; i<ASSET_COUNT; i++){
+		load(i);
+	}
+
+	//Editors save by rename as well: the directory is watched, not the files
+	notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(notifyFd >= 0 && inotify_add_watch(notifyFd, ".", IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0){
+		close(notifyFd);
+		notifyFd = -1;
+	}
+}
+
+assetCache::~assetCache(){
+	if(notifyFd >= 0)
+		close(notifyFd);
+	delete[] assets;
+}
+
+void assetCache::load(size_t i){
+	const assetFile &f = assetFiles[i];
+	staticAsset *asset = new staticAsset();
+	struct stat info;
+	if(!readFile(f.file, asset->body, info)){
+		cerr << "Error: " << f.file << " is not available." << endl;
+		delete asset;
+		atomic_store(&assets[i], shared_ptr<const staticAsset>());
+		return;
+	}
+
+	//The .gz is used only if it is not older than the file
+	string gzip = string(f.file) + ".gz";
+	struct stat gzipInfo;
+	if(!readFile(gzip.c_str(), asset->gzipBody, gzipInfo) || gzipInfo.st_mtime < info.st_mtime)
+		asset->gzipBody.clear();
+
+	string tag = fileTag(asset->body);
+	asset->etag = "\"" + tag + "\"";
+	stringstream headers;
+	headers << "HTTP/1.1 200 OK\r\nContent-Type: " << f.type << "\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n";
+	string common = headers.str();
+	asset->headers = common + "ETag: " + asset->etag + "\r\nContent-Length: " + to_string(asset->body.size()) + "\r\n\r\n";
+	asset->notModified = "HTTP/1.1 304 Not Modified\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\nETag: " + asset->etag + "\r\n\r\n";
+	if(!asset->gzipBody.empty()){
+		asset->gzipEtag = "\"" + tag + "-gz\"";
+		asset->gzipHeaders = common + "Content-Encoding: gzip\r\nETag: " + asset->gzipEtag + "\r\nContent-Length: " + to_string(asset->gzipBody.size()) + "\r\n\r\n";
+		asset->gzipNotModified = "HTTP/1.1 304 Not Modified\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\nETag: " + asset->gzipEtag + "\r\n\r\n";
+	}
+
+	//Connections sending the old one keep it until they are done
+	atomic_store(&assets[i], shared_ptr<const staticAsset>(asset));
+}
+
+int assetCache::watchFd(){
+	return notifyFd;
+}
+
+void assetCache::reload(){
+	char buffer[sizeof(struct inotify_event) + NAME_MAX + 1];
+	ssize_t n;
+	bool changed[ASSET_COUNT] = {false};
+
+	while((n = read(notifyFd, buffer, sizeof(buffer))) > 0){
+		for(char *p = buffer; p < buffer + n; ){
+			struct inotify_event *event = (struct inotify_event*)p;
+			for(size_t i=0; event->len > 0 && i<ASSET_COUNT; i++){
+				size_t length = strlen(assetFiles[i].file);
+				if(strncmp(event->name, assetFiles[i].file, length) == 0 && (event->name[length] == '\0' || strcmp(event->name + length, ".gz") == 0))
+					changed[i] = true;
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	for(size_t i=0; i<ASSET_COUNT; i++){
+		if(changed[i]){
+			load(i);
+			cout << "Reloaded " << assetFiles[i].file << endl;
+		}
+	}
+}
+
+shared_ptr<const staticAsset> assetCache::find(const httpSpan &path){
+	for(size_t i=0; i<ASSET_COUNT; i++){
+		if(path.is(assetFiles[i].path) || (i == 0 && path.is("/")))
+			return atomic_load(&assets[i]);
+	}
+	return shared_ptr<const staticAsset>();
+}
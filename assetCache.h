@@ -0,0 +1,43 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#pragma once
+
+#include <string>
+#include <memory>
+
+#include "httpRequest.h"
+
+using namespace std;
+
+/* a file of the GUI as it is sent: never changed once loaded, a reload makes a new one */
+struct staticAsset {
+	string body;
+	string headers;				// status line and headers of a 200
+	string notModified;			// whole 304
+	string etag;				// quoted hash of body
+	string gzipBody;			// "file.gz" next to the file, empty for none
+	string gzipHeaders;
+	string gzipNotModified;
+	string gzipEtag;
+};
+
+/* the files of the GUI in memory, loaded at start and again when they change on disk */
+class assetCache
+{
+private:
+	shared_ptr<const staticAsset> *assets;	// one per entry of the table in assetCache.cc, NULL if it cannot be read
+	int notifyFd;							// inotify on the directory of the files, -1 for none
+
+	void load(size_t i);
+
+public:
+	assetCache();
+	~assetCache();
+	int watchFd();							/* readable when a file changed: call reload() */
+	void reload();
+	shared_ptr<const staticAsset> find(const httpSpan &path);	/* NULL if path is not a file of the GUI */
+};
@@ -0,0 +1,351 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+/*
+ * agc-batch: runs a list of jobs headless, one agc per job, on a pool of
+ * threads. Every worker owns a queue and steals from the others when its
+ * own is empty. A job is one line of the job file:
+ *
+ *   name=v35 mct=4000000 keys=V35E
+ *   name=img rom=rom.bin erasable=ram.bin z=04054 engine=block
+ *
+ *   name      label copied in the report
+ *   rom       raw ROM image (16 bit words in memory format, host order)
+ *   erasable  raw erasable image, same format
+ *   snapshot  start from this snapshot (see agc::saveSnapshot) instead of booting;
+ *             each file is loaded once, its jobs take clones from an agcPool
+ *             and give them back to be reset for the next job
+ *   inputs    take the inputs recorded by agc -i at their MCT
+ *   mct       MCT budget (default 10000000, or up to the end of inputs)
+ *   z         stop when Z reaches this address (0 octal, 0x hex prefixes)
+ *   keys      DSKY keys: 0-9, V(erb), N(oun), E(nter), C(lear), R(eset),
+ *             K(ey rel), + and -
+ *   keyat     MCT of the first key (default 300000), counted from the start as mct
+ *   keygap    MCT between two keys (default 300000)
+ *   engine    interp, block or aot (default interp); aot needs the blocks
+ *             linked by "make batch-aot", a job stops on ERROR without them
+ *   speed     pace to the host clock at this factor (default unlimited)
+ *
+ * ALT and the exceptions stop a job as well. One JSON line per job is
+ * written on stdout when it ends, in completion order.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <map>
+
+#include "agc.h"
+#include "agcPool.h"
+
+using namespace std;
+
+struct batchJob {
+	int index;
+	string name;
+	string rom;
+	string erasable;
+	string snapshot;
+	string inputs;
+	long unsigned mct = 0;		// 0 for the default
+	int z = -1;
+	string keys;
+	long unsigned keyAt = 300000;
+	long unsigned keyGap = 300000;
+	agcOptions options;
+	string error;				// parse error, the job is reported and not run
+};
+
+struct workQueue {
+	mutex lock;
+	deque<batchJob*> jobs;
+};
+
+static vector<workQueue> queues;
+static mutex outputLock;
+static map<string, agcPool*> snapshots;	// loaded before the workers start, NULL if the file cannot be loaded
+
+static int keyCode(char c){
+
+	if(c >= '1' && c <= '9')
+		return KEY_1 + (c - '1');
+	switch(c){
+		case '0': return KEY_0;
+		case 'V': return KEY_VERB;
+		case 'N': return KEY_NOUN;
+		case 'E': return KEY_ENTR;
+		case 'C': return KEY_CLR;
+		case 'R': return KEY_RSET;
+		case 'K': return KEY_KEY_REL;
+		case '+': return KEY_ADD;
+		case '-': return KEY_SUB;
+		default: return -1;
+	}
+
+}
+
+static bool parseJob(const string &line, batchJob &job){
+
+	job.options.headless = true;
+	job.options.pacing = false;
+
+	stringstream fields(line);
+	string field;
+	while(fields >> field){
+		size_t eq = field.find('=');
+		if(eq == string::npos){
+			job.error = "bad field " + field;
+			return false;
+		}
+		string key = field.substr(0, eq);
+		string value = field.substr(eq + 1);
+		if(key == "name")
+			job.name = value;
+		else if(key == "rom")
+			job.rom = value;
+		else if(key == "erasable")
+			job.erasable = value;
+		else if(key == "snapshot")
+			job.snapshot = value;
+		else if(key == "inputs")
+			job.inputs = value;
+		else if(key == "mct")
+			job.mct = strtoul(value.c_str(), NULL, 0);
+		else if(key == "z")
+			job.z = strtol(value.c_str(), NULL, 0);
+		else if(key == "keys")
+			job.keys = value;
+		else if(key == "keyat")
+			job.keyAt = strtoul(value.c_str(), NULL, 0);
+		else if(key == "keygap")
+			job.keyGap = strtoul(value.c_str(), NULL, 0);
+		else if(key == "engine"){
+			if(value == "block")
+				job.options.blockEngine = true;
+			else if(value == "aot")
+				job.options.aotEngine = true;
+			else if(value != "interp"){
+				job.error = "bad engine " + value;
+				return false;
+			}
+		}
+		else if(key == "speed"){
+			job.options.speed = atof(value.c_str());
+			job.options.pacing = (job.options.speed > 0);
+		}
+		else{
+			job.error = "unknown field " + key;
+			return false;
+		}
+	}
+
+	for(size_t i = 0; i < job.keys.size(); i++){
+		if(keyCode(job.keys[i]) < 0){
+			job.error = string("bad key ") + job.keys[i];
+			return false;
+		}
+	}
+	return true;
+
+}
+
+static string quote(const string &s){
+
+	string q = "\"";
+	for(size_t i = 0; i < s.size(); i++){
+		if(s[i] == '"' || s[i] == '\\')
+			q += '\\';
+		q += s[i];
+	}
+	return q + "\"";
+
+}
+
+static void runJob(batchJob &job){
+
+	stringstream report;
+	report << "{\"job\":" << job.index << ",\"name\":" << quote(job.name);
+
+	if(!job.error.empty()){
+		report << ",\"stop\":\"ERROR\",\"error\":" << quote(job.error) << "}";
+		lock_guard<mutex> guard(outputLock);
+		cout << report.str() << endl;
+		return;
+	}
+
+	agcPool *pool = job.snapshot.empty() ? NULL : snapshots.at(job.snapshot);
+	agc *m = pool ? pool->acquire(job.options) : new agc(job.options);
+	string error;
+	if(!job.snapshot.empty() && pool == NULL)
+		error = "cannot load snapshot " + job.snapshot;
+	if(!job.rom.empty() && !m->loadImage(job.rom.c_str(), false))
+		error = "cannot read " + job.rom;
+	if(!job.erasable.empty() && !m->loadImage(job.erasable.c_str(), true))
+		error = "cannot read " + job.erasable;
+	if(job.options.aotEngine && !m->loadCompiledBlocks())
+		error = "no compiled blocks for this ROM (build with make batch-aot)";
+	long unsigned first = m->getMCT();
+	long unsigned end = first + (job.mct ? job.mct : 10000000);
+	if(!job.inputs.empty() && !m->replayInputs(job.inputs.c_str(), end))
+		error = "cannot read " + job.inputs;
+	if(job.mct)
+		end = first + job.mct;
+
+	auto start = steady_clock::now();
+	int fault = NO_FAULT;
+	int reason = STOP_MCT;
+	size_t key = 0;
+	while(error.empty()){
+		// Run up to the next key (or to the budget), then press it
+		long unsigned until = end;
+		if(key < job.keys.size())
+			until = min(until, first + job.keyAt + key * job.keyGap);
+		fault = m->emulate(until, job.z);
+		reason = m->getStopReason();
+		if(reason != STOP_MCT || m->getMCT() >= end)
+			break;
+		if(key < job.keys.size())
+			m->dskyInput(keyCode(job.keys[key++]));
+	}
+	double wall = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0;
+
+	if(!error.empty())
+		report << ",\"stop\":\"ERROR\",\"error\":" << quote(error);
+	else{
+		const char *stop = (fault != NO_FAULT) ? agc::exceptionName(fault) : (reason == STOP_Z ? "Z" : "MCT");
+		report << ",\"stop\":\"" << stop << "\""
+		<< ",\"mct\":" << m->getMCT()
+		<< ",\"wall_ms\":" << wall
+		<< ",\"realtime\":" << (wall > 0 ? (m->getMCT() - first) * CYCLE_PERIOD / 1000.0 / wall : 0)
+		<< ",\"registers\":" << m->getRegisters()
+		<< ",\"dsky\":" << m->getDSKYStatus();
+	}
+	report << "}";
+	if(pool)
+		pool->release(m);
+	else
+		delete m;
+
+	lock_guard<mutex> guard(outputLock);
+	cout << report.str() << endl;
+
+}
+
+static batchJob* nextJob(size_t self){
+
+	// Own queue first (front), then steal from the others (back)
+	for(size_t i = 0; i < queues.size(); i++){
+		workQueue &q = queues[(self + i) % queues.size()];
+		lock_guard<mutex> guard(q.lock);
+		if(q.jobs.empty())
+			continue;
+		batchJob *job;
+		if(i == 0){
+			job = q.jobs.front();
+			q.jobs.pop_front();
+		}
+		else{
+			job = q.jobs.back();
+			q.jobs.pop_back();
+		}
+		return job;
+	}
+	return NULL;
+
+}
+
+static void worker(size_t self){
+
+	batchJob *job;
+	while((job = nextJob(self)) != NULL)
+		runJob(*job);
+
+}
+
+void usage(const char *name) {
+	cerr << "Usage: " << name << " [-j threads] [jobfile]\n";
+	cerr << "  -j  worker threads (default: all cores)\n";
+	cerr << "  jobs are read from stdin when no file is given\n";
+}
+
+int main(int argc, char *argv[]){
+
+	char ch;
+	unsigned threads = thread::hardware_concurrency();
+
+	while ( (ch = getopt(argc, argv, "j:")) != -1) {
+		switch (ch) {
+			case 'j':
+				threads = atoi(optarg);
+				if(threads == 0){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if(threads == 0)
+		threads = 1;
+
+	ifstream file;
+	if(optind < argc){
+		file.open(argv[optind]);
+		if(!file){
+			cerr << "Cannot open " << argv[optind] << endl;
+			return 1;
+		}
+	}
+	istream &input = (optind < argc) ? file : cin;
+
+	vector<batchJob> jobs;
+	string line;
+	while(getline(input, line)){
+		size_t start = line.find_first_not_of(" \t");
+		if(start == string::npos || line[start] == '#')
+			continue;
+		batchJob job;
+		job.index = jobs.size();
+		parseJob(line, job);
+		jobs.push_back(job);
+	}
+
+	// A pool per snapshot, as many machines ready as threads may run its jobs at once
+	map<string, size_t> uses;
+	for(size_t i = 0; i < jobs.size(); i++){
+		if(!jobs[i].snapshot.empty())
+			uses[jobs[i].snapshot]++;
+	}
+	for(auto it = uses.begin(); it != uses.end(); it++){
+		agcOptions options;
+		options.headless = true;
+		agc base(options);
+		snapshots[it->first] = base.loadSnapshot(it->first.c_str()) ? new agcPool(base, min(it->second, (size_t)threads)) : NULL;
+	}
+
+	// Deal the jobs round robin, stealing evens out the rest
+	queues = vector<workQueue>(threads);
+	for(size_t i = 0; i < jobs.size(); i++)
+		queues[i % threads].jobs.push_back(&jobs[i]);
+
+	vector<thread> pool;
+	for(size_t i = 0; i < threads; i++)
+		pool.push_back(thread(worker, i));
+	for(size_t i = 0; i < pool.size(); i++)
+		pool[i].join();
+	for(auto it = snapshots.begin(); it != snapshots.end(); it++)
+		delete it->second;
+
+	return 0;
+
+}
@@ -0,0 +1,64 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+
+#include "checkpointLog.h"
+
+checkpointLog::checkpointLog(int fd){
+	this->fd = fd;
+	stopping = false;
+	failed = false;
+	writer = thread(&checkpointLog::write, this);
+}
+
+checkpointLog::~checkpointLog(){
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	writer.join();
+	close(fd);
+}
+
+void checkpointLog::append(vector<char> &record){
+	{
+		lock_guard<mutex> guard(lock);
+		pending.push_back(vector<char>());
+		pending.back().swap(record);
+	}
+	wake.notify_one();
+}
+
+void checkpointLog::write(){
+	unique_lock<mutex> guard(lock);
+	for(;;){
+		wake.wait(guard, [this]{ return stopping || !pending.empty(); });
+		if(pending.empty())//stopping, and everything is on file
+			return;
+		vector<char> record;
+		record.swap(pending.front());
+		pending.pop_front();
+		// The disk is slow: the CPU keeps queueing meanwhile
+		guard.unlock();
+		size_t done = 0;
+		while(!failed && done < record.size()){
+			ssize_t n = ::write(fd, record.data() + done, record.size() - done);
+			if(n < 0 && errno == EINTR)
+				continue;
+			if(n <= 0){
+				cerr << "Cannot write the checkpoint log, checkpoints are dropped\n";
+				failed = true;
+			}
+			else
+				done += n;
+		}
+		guard.lock();
+	}
+}
@@ -0,0 +1,35 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace std;
+
+/* file of checkpoints appended by a background thread: the CPU only queues them */
+class checkpointLog
+{
+private:
+	int fd;						// owned, closed by the destructor
+	deque<vector<char> > pending;
+	mutex lock;
+	condition_variable wake;
+	bool stopping;
+	bool failed;				// a write failed, the rest is dropped
+	thread writer;
+	
+	void write();
+
+public:
+	checkpointLog(int fd);
+	~checkpointLog();			/* writes what is still queued */
+	void append(vector<char> &record);	/* takes the record, leaves it empty */
+};
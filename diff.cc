@@ -0,0 +1,251 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+/*
+ * agc-diff: finds the first instruction at which two runs part.
+ *
+ *   agc-diff [-m mct] [-k mct] [-t seconds] "run" "run"
+ *   agc-diff [-m mct] [-k mct] [-s mct] -w trace "run"
+ *   agc-diff [-m mct] [-k mct] [-s mct] -c trace "run"
+ *
+ * A run is a list of fields, as a job of agc-batch:
+ *
+ *   rom       raw ROM image
+ *   erasable  raw erasable image
+ *   snapshot  start from this snapshot instead of booting
+ *   inputs    take the inputs recorded by agc -i at their MCT
+ *
+ * Runs go through the interpreter, up to mct (-m, default the end of the
+ * inputs or 10000000). Two runs of this build (two ROM images, two input
+ * records, ...) run side by side and compare state hashes every k MCT
+ * (-k, default 100000): on the first difference both go back to the last
+ * equal hash and step one instruction at a time, then both states are
+ * printed with debug(). Going back takes the history of the last t seconds
+ * of mission time (-t, default the length of an interval plus 2).
+ *
+ * Two builds cannot run in one process: each one writes (-w) or checks
+ * (-c) a trace of hashes taken every k MCT from MCT s (-s). The check
+ * prints the first interval that differs; -k 1 -s <start of it> on both
+ * builds narrows it to the instruction.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "agc.h"
+
+using namespace std;
+
+static agc* loadRun(const string &run, long unsigned &end){
+
+	agcOptions options;
+	options.headless = true;
+	options.pacing = false;
+	agc *m = new agc(options);
+
+	stringstream fields(run);
+	string field;
+	end = 10000000;
+	while(fields >> field){
+		size_t eq = field.find('=');
+		string key = field.substr(0, eq);
+		string value = (eq == string::npos) ? "" : field.substr(eq + 1);
+		bool loaded;
+		if(key == "rom")
+			loaded = m->loadImage(value.c_str(), false);
+		else if(key == "erasable")
+			loaded = m->loadImage(value.c_str(), true);
+		else if(key == "snapshot")
+			loaded = m->loadSnapshot(value.c_str());
+		else if(key == "inputs")
+			loaded = m->replayInputs(value.c_str(), end);
+		else{
+			cerr << "Unknown field " << field << endl;
+			loaded = false;
+		}
+		if(!loaded){
+			cerr << "Cannot load " << field << endl;
+			delete m;
+			return NULL;
+		}
+	}
+	return m;
+
+}
+
+static void report(agc &a, agc &b){
+
+	cout << "First difference after " << a.getSteps() << " instructions (MCT " << a.getMCT() << " and " << b.getMCT() << ")\n";
+	cout << "\n\tFIRST RUN";
+	a.debug();
+	cout << "\n\tSECOND RUN";
+	b.debug();
+	a.debugDiff(b);
+
+}
+
+static int compare(agc &a, agc &b, long unsigned end, long unsigned k, long unsigned seconds){
+
+	// The last interval is run again from the history
+	a.startHistory(seconds);
+	b.startHistory(seconds);
+
+	long unsigned equal = a.getSteps();
+	bool same = (a.stateHash() == b.stateHash());
+	while(same && a.getMCT() < end){
+		long unsigned t = min(a.getMCT() + k, end);
+		int ea = a.emulate(t);
+		int eb = b.emulate(t);
+		same = (a.stateHash() == b.stateHash());
+		if(same && (ea != NO_FAULT || eb != NO_FAULT)){
+			cout << "Both runs stopped on " << agc::exceptionName(ea) << " at MCT " << a.getMCT() << endl;
+			return 0;
+		}
+		if(same)
+			equal = a.getSteps();
+	}
+	if(same){
+		cout << "No difference up to MCT " << a.getMCT() << " (" << a.getSteps() << " instructions)\n";
+		return 0;
+	}
+
+	// Equal at equal, different at the end of the interval: step to the first difference
+	long unsigned parted = a.getMCT();
+	if(!a.travel(equal) || !b.travel(equal)){
+		cout << "The runs part after instruction " << equal << " and before MCT " << parted << ", but instruction " << equal
+			<< " is out of the history of " << seconds << " s: run again with a larger -t\n";
+		return 2;
+	}
+	while(a.stateHash() == b.stateHash()){
+		int ea = a.step();
+		int eb = b.step();
+		if(ea != NO_FAULT || eb != NO_FAULT)
+			break;
+	}
+	report(a, b);
+	return 1;
+
+}
+
+static int writeTrace(agc &m, const char *path, long unsigned end, long unsigned k, long unsigned from){
+
+	ofstream trace(path, ios::trunc);
+	if(!trace){
+		cerr << "Cannot create " << path << endl;
+		return 2;
+	}
+	int e = (from > m.getMCT()) ? m.emulate(from) : NO_FAULT;
+	for(;;){
+		trace << m.getSteps() << ' ' << m.getMCT() << ' ' << hex << m.stateHash() << dec << '\n';
+		if(e != NO_FAULT || m.getMCT() >= end)
+			break;
+		e = m.emulate(min(m.getMCT() + k, end));
+	}
+	return 0;
+
+}
+
+static int checkTrace(agc &m, const char *path){
+
+	ifstream trace(path);
+	if(!trace){
+		cerr << "Cannot open " << path << endl;
+		return 2;
+	}
+	long unsigned steps, mct, previous = m.getMCT();
+	uint64_t hash;
+	while(trace >> steps >> mct >> hex >> hash >> dec){
+		if(mct > m.getMCT())
+			m.emulate(mct);
+		if(m.getSteps() != steps || m.getMCT() != mct || m.stateHash() != hash){
+			cout << "First difference between MCT " << previous << " and " << mct
+				<< " (trace: " << steps << " instructions at MCT " << mct << ", this build: "
+				<< m.getSteps() << " at MCT " << m.getMCT() << ")\n";
+			m.debug();
+			return 1;
+		}
+		previous = mct;
+	}
+	cout << "No difference up to MCT " << previous << endl;
+	return 0;
+
+}
+
+void usage(const char *name) {
+	cerr << "Usage: " << name << " [-m mct] [-k mct] [-t seconds] \"run\" \"run\"\n";
+	cerr << "       " << name << " [-m mct] [-k mct] [-s mct] -w|-c trace \"run\"\n";
+	cerr << "  -m  MCT to compare up to (default the end of the inputs, or 10000000)\n";
+	cerr << "  -k  MCT between two hashes (default 100000)\n";
+	cerr << "  -t  seconds of mission time kept to go back to the last equal hash (default k in seconds + 2)\n";
+	cerr << "  -s  MCT of the first hash of a trace\n";
+	cerr << "  -w  write a trace of hashes\n";
+	cerr << "  -c  check against a trace written by another build\n";
+	cerr << "  a run is a list of fields: rom=file erasable=file snapshot=file inputs=file\n";
+}
+
+int main(int argc, char *argv[]){
+
+	char ch;
+	long unsigned end = 0;
+	long unsigned k = 100000;
+	long unsigned from = 0;
+	long unsigned seconds = 0;
+	const char *write = NULL;
+	const char *check = NULL;
+
+	while ( (ch = getopt(argc, argv, "m:k:s:t:w:c:")) != -1) {
+		switch (ch) {
+			case 'm':
+				end = strtoul(optarg, NULL, 0);
+				break;
+			case 'k':
+				k = strtoul(optarg, NULL, 0);
+				if(k == 0){
+					usage(argv[0]);
+					return 2;
+				}
+				break;
+			case 's':
+				from = strtoul(optarg, NULL, 0);
+				break;
+			case 't':
+				seconds = strtoul(optarg, NULL, 0);
+				break;
+			case 'w':
+				write = optarg;
+				break;
+			case 'c':
+				check = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	int runs = (write || check) ? 1 : 2;
+	if(argc - optind != runs || (write && check)){
+		usage(argv[0]);
+		return 2;
+	}
+
+	long unsigned endA, endB = 0;
+	agc *a = loadRun(argv[optind], endA);
+	agc *b = (runs == 2) ? loadRun(argv[optind + 1], endB) : NULL;
+	if(a == NULL || (runs == 2 && b == NULL))
+		return 2;
+	if(end == 0)
+		end = max(endA, endB);
+
+	if(write)
+		return writeTrace(*a, write, end, k, from);
+	if(check)
+		return checkTrace(*a, check);
+	if(seconds == 0)
+		seconds = k * CYCLE_PERIOD / 1000000 + 2;
+	return compare(*a, *b, end, k, seconds);
+
+}
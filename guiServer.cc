@@ -12,144 +12,585 @@
 #include <netinet/in.h>
 #include <string.h>
 #include <cstring>
-#include <fstream>
 #include <sstream>
-#include <regex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 
 #include "guiServer.h"
 #include "dskyConstants.h"
+#include "webSocket.h"
+#include "httpRequest.h"
+#include "assetCache.h"
 
 using namespace std;
 
-int fetchRequest(char *buffer){
-	const regex index_template("(GET \\/(index\\.html)? HTTP\\/\\d\\.\\d)");
-	const regex status_template("(GET \\/status HTTP\\/\\d\\.\\d)");
-	const regex keypress_template("(GET \\/button\\/[a-z0-9]{1} HTTP\\/\\d\\.\\d)");
-	
-	string request(buffer);
-
-	smatch m;
-	regex_search(request, m, index_template);
-//	for(auto v: m) std::cout << v << std::endl;//DEBUG
-	if(!m.empty() && m[0].matched){
-//		cout << "Requested index.html" << endl;//DEBUG
+int fetchRequest(const httpRequest &request){
+	if(request.method.is("POST"))
+		return request.path.is("/keys") ? 5 : 0;
+	if(!request.method.is("GET"))
+		return 0;
+	if(request.path.is("/") || request.path.is("/index.html"))
 		return 1;
-	}
-	
-	regex_search(request, m, status_template);
-//	for(auto v: m) std::cout << v << std::endl;//DEBUG
-	if(!m.empty() && m[0].matched){
-//		cout << "Status request" << endl;//DEBUG
+	if(request.path.is("/status"))
 		return 2;
-	}
-	
-	regex_search(request, m, keypress_template);
-//	for(auto v: m) std::cout << v << std::endl;//DEBUG
-	if(!m.empty() && m[0].matched){
-//		cout << "Key press" << endl;//DEBUG
+	if(request.path.length == 9 && request.path.startsWith("/button/"))
 		return 3;
+	if(request.path.is("/ws"))
+		return 4;
+	return 0;
+}
+
+/* KEY_* of each character of /button/<c>, of WebSocket messages and of POST /keys, 0 for none */
+struct keyTable {
+	uint8_t key[256];
+	
+	keyTable(){
+		memset(key, 0, sizeof(key));
+		for(int i=1; i<=9; i++){
+			key['0' + i] = KEY_1 + (i - 1);
+		}
+		key['0'] = KEY_0;
+		key['a'] = KEY_ADD;
+		key['s'] = KEY_SUB;
+		key['v'] = KEY_VERB;
+		key['n'] = KEY_NOUN;
+		key['c'] = KEY_CLR;
+		key['p'] = KEY_PRO_PRESS;
+		key['z'] = KEY_PRO_RELEASE;
+		key['k'] = KEY_KEY_REL;
+		key['e'] = KEY_ENTR;
+		key['r'] = KEY_RSET;
+		key['+'] = KEY_ADD;
+		key['-'] = KEY_SUB;
+		key['V'] = KEY_VERB;
+		key['N'] = KEY_NOUN;
+		key['C'] = KEY_CLR;
+		key['K'] = KEY_KEY_REL;
+		key['E'] = KEY_ENTR;
+		key['R'] = KEY_RSET;
 	}
+};
+
+static const keyTable keys;
+
+int keyFromChar(char c){
+	return keys.key[(uint8_t)c];
+}
+
+int getKey(const httpRequest &request){
+	return keyFromChar(request.path.data[8]);
+}
+
+/* /status is rendered once per version of the display, 304 when the client has it */
+struct statusCache {
+	uint64_t version;		// of the frame rendered, 0 for none
+	string etag;			// "boot.version": versions start again with the process
+	string response;		// 200, headers and body
+	string notModified;		// 304
+};
+
+static bool inputKey(agc &agc, int key){
+	if(key == KEY_PRO_PRESS)
+		return agc.setProBit();
+	if(key == KEY_PRO_RELEASE)
+		return agc.resetProBit();
+	if(key > 0 && key <= 100)
+		return agc.dskyInput((uint16_t)key);
+	return false;
+}
+
+/* a client of a worker: HTTP requests, then frames if it upgrades to a WebSocket */
+struct connection {
+	int fd;
+	bool webSocket;
+	bool closing;			// closed once out is sent
+	bool waiting;			// out is not all sent: EPOLLOUT is on
+	bool fresh;				// WebSocket: nothing sent yet, the first message is the whole display
+	dskyFrame shown;		// WebSocket: last frame sent
+	string in;				// bytes received and not handled yet
+	string out;				// bytes to send
+	size_t sent;			// of out
+	shared_ptr<const staticAsset> asset;	// kept while its body is sent
+	const string *body;		// of asset, sent after out without a copy; NULL for none
+	size_t bodySent;
+	uint64_t ticket;		// POST /keys: answered once the CPU took this input, 0 for none
+	size_t keys;			// of the sequence
+	time_t parked;			// POST /keys: when its keys were queued, for GUI_KEYS_TIMEOUT
+	time_t active;			// last request or bytes sent, for GUI_IDLE_TIMEOUT
+};
+
+/* a thread of the server: its own epoll set, connections and eventfd of the DSKY */
+struct guiWorker {
+	int epoll;
+	int wake;
+	unordered_map<int, connection> connections;
+	statusCache status;
+};
+
+static long bootTag = 0;
+static int listener = -1;
+static assetCache *assets = NULL;
+
+static void refreshStatus(agc &agc, statusCache &cache){
+	dskyFrame frame;
+	uint64_t version = agc.getDSKYFrame(frame);
+	if(version == cache.version)
+		return;
 	
-//	cout << "Sequence not found" << endl;//DEBUG
-	return 0;
+	string responseBody = DSKYLogic::format(frame);
+	stringstream etag;
+	etag << "\"" << bootTag << "." << version << "\"";
+	stringstream headers;
+	headers << "Content-Type: application/json\r\nCache-Control: no-cache\r\nETag: " << etag.str() << "\r\n";
+	cache.version = version;
+	cache.etag = etag.str();
+	cache.response = "HTTP/1.1 200 OK\r\n" + headers.str() + "Content-Length: " + to_string(responseBody.length()) + "\r\n\r\n" + responseBody;
+	cache.notModified = "HTTP/1.1 304 Not Modified\r\n" + headers.str() + "\r\n";
 }
 
-int getKey(char *buffer){
-	const regex key_template("(GET \\/button\\/)([a-z0-9]{1})");
+/* ?since=version or If-None-Match with the current ETag */
+static bool statusUnchanged(const httpRequest &request, const statusCache &cache){
+	httpSpan since = request.parameter("since");
+	if(since.data)
+		return spanNumber(since) == (long long)cache.version;
 	
-	string request(buffer);
+	httpSpan tags = request.header("If-None-Match");
+	return tags.data && memmem(tags.data, tags.length, cache.etag.data(), cache.etag.size()) != NULL;
+}
+
+static string jsonResponse(const string &responseBody, const char *status = "200 OK"){
+	stringstream stringStream;
+	stringStream << "HTTP/1.1 " << status << "\r\nContent-Type: application/json\r\nContent-Length: " << responseBody.length() << "\r\n\r\n" << responseBody;
+	return stringStream.str();
+}
 
-	smatch m;
-	regex_search(request, m, key_template);
+/* a file of the GUI from the cache: only the headers are copied, the body is sent from the cache */
+static string assetResponse(connection &c, const httpRequest &request){
+	shared_ptr<const staticAsset> asset = assets->find(request.path);
+	if(!asset)
+		return "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nError";
 	
-//	for(auto v: m) std::cout << v << std::endl;//DEBUG
-	if(!m.empty() && m[0].matched){
-//		cout << "Key found" << endl;//DEBUG
-		if(m[2].matched){
-			if(m[2].str() == "0"){
-				return KEY_0;
-			}
-			else if(m[2].str() == "1"){
-				return KEY_1;
-			}
-			else if(m[2].str() == "2"){
-				return KEY_2;
-			}
-			else if(m[2].str() == "3"){
-				return KEY_3;
-			}
-			else if(m[2].str() == "4"){
-				return KEY_4;
-			}
-			else if(m[2].str() == "5"){
-				return KEY_5;
-			}
-			else if(m[2].str() == "6"){
-				return KEY_6;
-			}
-			else if(m[2].str() == "7"){
-				return KEY_7;
-			}
-			else if(m[2].str() == "8"){
-				return KEY_8;
-			}
-			else if(m[2].str() == "9"){
-				return KEY_9;
-			}
-			else if(m[2].str() == "a"){
-				return KEY_ADD;
-			}
-			else if(m[2].str() == "s"){
-				return KEY_SUB;
-			}
-			else if(m[2].str() == "v"){
-				return KEY_VERB;
-			}
-			else if(m[2].str() == "n"){
-				return KEY_NOUN;
+	httpSpan encodings = request.header("Accept-Encoding");
+	bool gzip = !asset->gzipBody.empty() && encodings.data && memmem(encodings.data, encodings.length, "gzip", 4) != NULL;
+	const string &etag = gzip ? asset->gzipEtag : asset->etag;
+	httpSpan tags = request.header("If-None-Match");
+	if(tags.data && memmem(tags.data, tags.length, etag.data(), etag.size()) != NULL)
+		return gzip ? asset->gzipNotModified : asset->notModified;
+	
+	const string &body = gzip ? asset->gzipBody : asset->body;
+	if(!body.empty()){
+		c.asset = asset;
+		c.body = &body;
+		c.bodySent = 0;
+	}
+	return gzip ? asset->gzipHeaders : asset->headers;
+}
+
+/* POST /keys?gap=<MCT>: the body is a sequence of keys (V16N36E), queued as a whole and taken gap MCT apart; no response until the CPU took the last one */
+static string keysResponse(agc &agc, connection &c, const httpRequest &request, const httpSpan &body){
+	uint16_t sequence[INPUT_QUEUE_SIZE];
+	size_t count = 0;
+	for(size_t i=0; i<body.length; i++){
+		char k = body.data[i];
+		if(k == ' ' || k == '\t' || k == '\r' || k == '\n')
+			continue;
+		int key = keyFromChar(k);
+		if(key <= 0 || key > 100 || count == INPUT_QUEUE_SIZE)
+			return jsonResponse("{\"success\":false,\"message\":\"Bad key sequence\"}");
+		sequence[count++] = key;
+	}
+	httpSpan gapParameter = request.parameter("gap");
+	long long gap = gapParameter.data ? spanNumber(gapParameter) : GUI_KEY_GAP;
+	if(count == 0 || gap < 0 || gap > UINT32_MAX)
+		return jsonResponse("{\"success\":false,\"message\":\"Bad key sequence\"}");
+	
+	uint64_t ticket = agc.queueKeys(sequence, count, (uint32_t)gap);
+	if(ticket == 0)
+		return jsonResponse("{\"success\":false,\"message\":\"Input queue full\"}");
+	c.ticket = ticket;
+	c.keys = count;
+	c.parked = time(NULL);
+	return "";
+}
+
+/* the response of POST /keys once its last key is taken: false while it is not */
+static bool keysTaken(agc &agc, connection &c){
+	if(c.ticket == 0 || !agc.inputTaken(c.ticket))
+		return false;
+	c.out += jsonResponse("{\"success\":true,\"keys\":" + to_string(c.keys) + ",\"message\":\"Keys taken\"}");
+	c.ticket = 0;
+	return true;
+}
+
+/* the response of POST /keys after GUI_KEYS_TIMEOUT (the CPU is stopped or the gap too long): false while it is not due;
+   the keys stay queued */
+static bool keysExpired(connection &c, time_t now){
+	if(c.ticket == 0 || now - c.parked <= GUI_KEYS_TIMEOUT)
+		return false;
+	c.out += jsonResponse("{\"success\":false,\"keys\":" + to_string(c.keys) + ",\"message\":\"Keys not taken in time\"}", "504 Gateway Timeout");
+	c.ticket = 0;
+	return true;
+}
+
+/* response to a request; upgrade: the connection is a WebSocket from now on */
+static string respond(agc &agc, guiWorker &w, connection &c, const httpRequest &request, const httpSpan &body, bool &upgrade){
+	string response;
+	bool &closing = c.closing;
+	
+	//HTTP/1.1 keeps the connection unless asked not to, HTTP/1.0 does not
+	closing = request.minor == 0 || request.header("Connection").isNoCase("close");
+	
+	int requestType = fetchRequest(request);
+	if(requestType == 1){
+		response = assetResponse(c, request);
+		//aggiungere eventuale ritardo
+		agc.run();
+	}
+	else if(requestType == 2){
+		refreshStatus(agc, w.status);
+		response = statusUnchanged(request, w.status) ? w.status.notModified : w.status.response;
+	}
+	else if(requestType == 3){
+		int keyPressed = getKey(request);
+		stringstream buffer;
+		
+		if(keyPressed > 0 && keyPressed <= 100){
+			if(inputKey(agc, keyPressed))
+				buffer << "{\"success\":true,\"key\":" << keyPressed << ",\"message\":\"Key " << keyPressed << " pressed\"}";
+			else
+				buffer << "{\"success\":false,\"key\":" << keyPressed << ",\"message\":\"Input queue full\"}";
+		}
+		else if(keyPressed == KEY_PRO_PRESS || keyPressed == KEY_PRO_RELEASE){
+			if(inputKey(agc, keyPressed))
+				buffer << "{\"success\":true,\"key\":" << keyPressed << ",\"message\":\"Key PRO " << (keyPressed == KEY_PRO_PRESS ? "pressed" : "released") << "\"}";
+			else
+				buffer << "{\"success\":false,\"key\":" << keyPressed << ",\"message\":\"Input queue full\"}";
+		}
+		else
+			buffer << "{\"success\":false,\"message\":\"Bad key event\"}";
+		response = jsonResponse(buffer.str());
+	}
+	else if(requestType == 4 && request.header("Sec-WebSocket-Key").length > 0){
+		httpSpan key = request.header("Sec-WebSocket-Key");
+		response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
+			+ wsAccept(string(key.data, key.length)) + "\r\n\r\n";
+		closing = false;
+		upgrade = true;
+		agc.run();
+	}
+	else if(requestType == 5){
+		response = keysResponse(agc, c, request, body);
+		agc.run();
+	}
+	else{
+		response = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nError";
+		closing = true;
+	}
+	return response;
+}
+
+/* sends what it can of out, then of body, without blocking: false when the connection is over */
+static bool flush(guiWorker &w, connection &c){
+	while(c.sent < c.out.size() || c.body){
+		//Both in one call: the headers do not go out in a packet of their own
+		iovec parts[2];
+		msghdr message;
+		memset(&message, 0, sizeof(message));
+		message.msg_iov = parts;
+		if(c.sent < c.out.size()){
+			parts[message.msg_iovlen].iov_base = (char*)c.out.data() + c.sent;
+			parts[message.msg_iovlen++].iov_len = c.out.size() - c.sent;
+		}
+		if(c.body){
+			parts[message.msg_iovlen].iov_base = (char*)c.body->data() + c.bodySent;
+			parts[message.msg_iovlen++].iov_len = c.body->size() - c.bodySent;
+		}
+		ssize_t n = sendmsg(c.fd, &message, MSG_NOSIGNAL);
+		if(n > 0){
+			c.active = time(NULL);
+			size_t head = min((size_t)n, c.out.size() - c.sent);
+			c.sent += head;
+			if(c.body && (c.bodySent += n - head) == c.body->size()){
+				c.body = NULL;
+				c.asset.reset();
 			}
-			else if(m[2].str() == "c"){
-				return KEY_CLR;
+		}
+		else if(n < 0 && errno == EINTR)
+			continue;
+		else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+			return false;
+	}
+	if(c.sent == c.out.size()){
+		c.out.clear();
+		c.sent = 0;
+		if(c.closing && !c.body && !c.ticket)
+			return false;
+	}
+	
+	//Waits for EPOLLOUT only while something is left
+	bool waiting = !c.out.empty() || c.body;
+	if(waiting != c.waiting){
+		epoll_event event;
+		event.events = EPOLLIN | (waiting ? EPOLLOUT : 0);
+		event.data.fd = c.fd;
+		epoll_ctl(w.epoll, EPOLL_CTL_MOD, c.fd, &event);
+		c.waiting = waiting;
+	}
+	return true;
+}
+
+/* the display a viewer has not seen yet, once it has taken the previous one: a slow viewer skips frames, it never piles them up */
+static void push(connection &c, const dskyFrame &frame){
+	if(!c.fresh && (!c.out.empty() || memcmp(&c.shown, &frame, sizeof(frame)) == 0))
+		return;
+	c.out += wsFrame(WS_TEXT, DSKYLogic::format(frame, c.fresh ? NULL : &c.shown));
+	c.shown = frame;
+	c.fresh = false;
+}
+
+/* WebSocket frames received: false when the viewer broke the protocol */
+static bool readFrames(agc &agc, connection &c){
+	uint8_t opcode;
+	string payload;
+	long used;
+	while(!c.closing && (used = wsParse(c.in.data(), c.in.size(), opcode, payload)) > 0){
+		c.in.erase(0, used);
+		if(opcode == WS_CLOSE){
+			c.out += wsFrame(WS_CLOSE, payload.substr(0, 2));
+			c.closing = true;
+		}
+		else if(opcode == WS_PING)
+			c.out += wsFrame(WS_PONG, payload);
+		else if(opcode == WS_TEXT){
+			//A message is a string of key characters, as in /button/<c>
+			for(size_t i=0; i<payload.size(); i++){
+				if(!inputKey(agc, keyFromChar(payload[i])))
+					c.out += wsFrame(WS_TEXT, "{\"success\":false,\"message\":\"Key not taken\"}");
 			}
-			else if(m[2].str() == "p"){
-				return KEY_PRO_PRESS;
+		}
+	}
+	return c.closing || used == 0;
+}
+
+/* requests received: false when the connection is over */
+static bool readRequests(agc &agc, guiWorker &w, connection &c){
+	//Parsed in place: nothing is copied before the response
+	//A pipelined request waits for the body before it: that is sent last, out of out; and for the keys of a POST /keys
+	size_t taken = 0;
+	bool upgrade = false;
+	while(!c.closing && !upgrade && !c.body && !c.ticket){
+		httpRequest request;
+		int parsed = parseRequest(c.in.data() + taken, c.in.size() - taken, request);
+		if(parsed == 0 && c.in.size() - taken > GUI_MAX_REQUEST)
+			parsed = -1;
+		if(parsed == 0)
+			break;
+		if(parsed < 0){
+			c.out += "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nError";
+			c.closing = true;
+			break;
+		}
+		
+		//A body is taken when it is all there (only POST /keys reads it)
+		httpSpan length = request.header("Content-Length");
+		long long body = length.data ? spanNumber(length) : 0;
+		if(body < 0 || body > GUI_MAX_REQUEST){
+			c.out += "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nError";
+			c.closing = true;
+			break;
+		}
+		if(c.in.size() - taken < request.length + body)
+			break;
+		
+		httpSpan content = {c.in.data() + taken + request.length, (size_t)body};
+		c.out += respond(agc, w, c, request, content, upgrade);
+		taken += request.length + body;
+	}
+	c.in.erase(0, taken);
+	
+	if(upgrade){
+		c.webSocket = true;
+		c.fresh = true;
+		dskyFrame frame;
+		agc.getDSKYFrame(frame);
+		push(c, frame);
+		return readFrames(agc, c);
+	}
+	return true;
+}
+
+/* requests and responses until the socket is full or a request is not all there */
+static bool serveRequests(agc &agc, guiWorker &w, connection &c){
+	while(1){
+		if(!readRequests(agc, w, c))
+			return false;
+		bool body = c.body != NULL;
+		if(!flush(w, c))
+			return false;
+		//Requests stopped behind a body that is now sent
+		if(!body || c.body || c.webSocket || c.in.empty())
+			return true;
+	}
+}
+
+static bool readConnection(agc &agc, guiWorker &w, connection &c){
+	char buffer[4096];
+	while(1){
+		ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+		if(n > 0)
+			c.in.append(buffer, n);
+		else if(n < 0 && errno == EINTR)
+			continue;
+		else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+			return false;
+	}
+	c.active = time(NULL);
+	if(c.webSocket)
+		return readFrames(agc, c) && flush(w, c);
+	return serveRequests(agc, w, c);
+}
+
+static void closeConnection(guiWorker &w, int fd){
+	close(fd);
+	w.connections.erase(fd);
+}
+
+static void acceptConnections(guiWorker &w){
+	while(1){
+		int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if(fd < 0)
+			return;//EAGAIN: another worker took it, or none left
+		int option = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&option, sizeof(option));
+		
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		if(epoll_ctl(w.epoll, EPOLL_CTL_ADD, fd, &event) < 0){
+			close(fd);
+			continue;
+		}
+		connection &c = w.connections[fd];
+		c.fd = fd;
+		c.webSocket = false;
+		c.closing = false;
+		c.waiting = false;
+		c.fresh = false;
+		c.sent = 0;
+		c.body = NULL;
+		c.bodySent = 0;
+		c.ticket = 0;
+		c.active = time(NULL);
+	}
+}
+
+static void workerLoop(agc &agc, guiWorker *w){
+	epoll_event events[GUI_MAX_EVENTS];
+	time_t sweep = time(NULL);
+	
+	while(1){
+		int n = epoll_wait(w->epoll, events, GUI_MAX_EVENTS, 1000);
+		for(int i=0; i<n; i++){
+			int fd = events[i].data.fd;
+			if(fd == listener){
+				acceptConnections(*w);
+				continue;
 			}
-			else if(m[2].str() == "z"){
-				return KEY_PRO_RELEASE;
+			
+			if(fd == assets->watchFd()){
+				assets->reload();
+				continue;
 			}
-			else if(m[2].str() == "k"){
-				return KEY_KEY_REL;
+			
+			if(fd == w->wake){
+				//A new frame: to every viewer of this worker; or keys taken: the POST /keys waiting for them
+				uint64_t count;
+				if(read(w->wake, &count, sizeof(count)) < 0)
+					;//already read
+				dskyFrame frame;
+				agc.getDSKYFrame(frame);
+				for(auto it = w->connections.begin(); it != w->connections.end(); ){
+					connection &c = (it++)->second;
+					if(keysTaken(agc, c)){
+						if(!serveRequests(agc, *w, c))
+							closeConnection(*w, c.fd);
+						continue;
+					}
+					if(!c.webSocket)
+						continue;
+					push(c, frame);
+					if(!flush(*w, c))
+						closeConnection(*w, c.fd);
+				}
+				continue;
 			}
-			else if(m[2].str() == "e"){
-				return KEY_ENTR;
+			
+			auto it = w->connections.find(fd);
+			if(it == w->connections.end())
+				continue;
+			connection &c = it->second;
+			bool alive = !(events[i].events & EPOLLERR);
+			if(alive && (events[i].events & (EPOLLIN | EPOLLHUP)))
+				alive = readConnection(agc, *w, c);
+			if(alive && (events[i].events & EPOLLOUT)){
+				alive = flush(*w, c);
+				if(alive && c.webSocket && c.out.empty()){
+					//Sent: the viewer is ready for the frames it skipped
+					dskyFrame frame;
+					agc.getDSKYFrame(frame);
+					push(c, frame);
+					alive = flush(*w, c);
+				}
+				else if(alive && !c.webSocket && !c.body && !c.in.empty()){
+					//The body is out: requests that came after it
+					alive = serveRequests(agc, *w, c);
+				}
 			}
-			else if(m[2].str() == "r"){
-				return KEY_RSET;
+			if(!alive)
+				closeConnection(*w, fd);
+		}
+		
+		//Idle HTTP connections are closed, viewers stay; POST /keys waiting for the CPU get their deadline
+		time_t now = time(NULL);
+		if(now != sweep){
+			sweep = now;
+			for(auto it = w->connections.begin(); it != w->connections.end(); ){
+				connection &c = (it++)->second;
+				if(keysExpired(c, now)){
+					if(!serveRequests(agc, *w, c))
+						closeConnection(*w, c.fd);
+				}
+				else if(!c.webSocket && !c.ticket && now - c.active > GUI_IDLE_TIMEOUT)
+					closeConnection(*w, c.fd);
 			}
 		}
 	}
-		
-	return 0;
-
 }
 
 void serverStart(agc &agc){
-	int port = 8080;
-	int server_fd, new_socket; 
-	long valread;
+	int port = GUI_PORT;
 	struct sockaddr_in address;
-	int addrlen = sizeof(address);
-	string response;
 
-    if((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0){
+	if((listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0){
 		cerr << "Error in GUI socket creation." << endl;
 		exit(EXIT_FAILURE);
 	}
 	
 	int option = 1;
-	if(setsockopt(server_fd, SOL_SOCKET, (SO_REUSEPORT | SO_REUSEADDR), (char*)&option, sizeof(option)) < 0){
+	if(setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (char*)&option, sizeof(option)) < 0){
 		cerr << "Error in GUI socket creation: setsockopt failed" << endl;
-		close(server_fd);
+		close(listener);
 		exit(EXIT_FAILURE);
 	}
 	
@@ -160,92 +601,55 @@ void serverStart(agc &agc){
 
 	memset(address.sin_zero, '\0', sizeof address.sin_zero);
 
-	if(bind(server_fd, (struct sockaddr *)&address, sizeof(address))<0){
+	if(bind(listener, (struct sockaddr *)&address, sizeof(address))<0){
 		cerr << "Error in GUI socket binding. Port " << port << " seems busy." << endl;
 		exit(EXIT_FAILURE);
 	}
 	
-	if(listen(server_fd, 10) < 0){
+	if(listen(listener, SOMAXCONN) < 0){
 		cerr << "Error in GUI socket listen." << endl;
 		exit(EXIT_FAILURE);
 	}
+	bootTag = time(NULL);
+	assets = new assetCache();
 	
-	cout << "Type \"localhost:" << port << "/index.html\" in your browser to connect to the AGC emulator." << endl;
-	while(1){
-		if((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen))<0){
-			cerr << "Error in GUI." << endl;
+	//Every worker waits on the listener; EPOLLEXCLUSIVE wakes one of them per connection
+	unsigned workers = min(thread::hardware_concurrency(), (unsigned)GUI_WORKERS);
+	if(workers == 0)
+		workers = 1;
+	vector<guiWorker*> pool;
+	for(unsigned i=0; i<workers; i++){
+		guiWorker *w = new guiWorker();
+		w->epoll = epoll_create1(EPOLL_CLOEXEC);
+		w->wake = agc.watchDSKY();
+		w->status.version = 0;
+		if(w->epoll < 0){
+			cerr << "Error in GUI: epoll_create1 failed." << endl;
 			exit(EXIT_FAILURE);
 		}
-		
-		char buffer[1000] = {0};
-		valread = read( new_socket , buffer, 1000);
-		if(valread < 0)
-			continue;
-//		cout << buffer << endl;//DEBUG
-		int requestType = fetchRequest(buffer);
-		if(requestType == 1){
-			string responseBody;
-			ifstream file("./index.html");
-			if(file){
-				stringstream buffer;
-				buffer << file.rdbuf();
-				responseBody = buffer.str();
-				file.close();
-			}
-			else{
-				cerr << "Error: index.html is not available." << endl;
-			}
-			
-			stringstream stringStream;
-			stringStream << "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: " << responseBody.length() << "\r\n\r\n" << responseBody;
-			response = stringStream.str();
-			//aggiungere eventuale ritardo
-			agc.run();
-		}
-		else if(requestType == 2){
-			string responseBody = agc.getDSKYStatus();
-			stringstream stringStream;
-			stringStream << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << responseBody.length() << "\r\n\r\n" << responseBody;
-			response = stringStream.str();
-		}
-		else if(requestType == 3){
-			int keyPressed = getKey(buffer);
-			
-			if(keyPressed > 0 && keyPressed <= 100){
-				agc.dskyInput((uint16_t)keyPressed);
-				stringstream buffer;
-				buffer << "{\x22success\x22:true,\x22key\x22:" << keyPressed << ",\x22message\x22:\x22Key " << keyPressed << " pressed\x22}";
-				string responseBody = buffer.str();
-				stringstream stringStream;
-				stringStream << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << responseBody.length() << "\r\n\r\n" << responseBody;
-				response = stringStream.str();
-			}
-			else if(keyPressed == 101){
-				agc.setProBit();
-				stringstream buffer;
-				buffer << "{\x22success\x22:true,\x22key\x22:" << keyPressed << ",\x22message\x22:\x22Key PRO pressed\x22}";
-				string responseBody = buffer.str();
-				stringstream stringStream;
-				stringStream << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << responseBody.length() << "\r\n\r\n" << responseBody;
-				response = stringStream.str();
-			}
-			else if(keyPressed == 102){
-				agc.resetProBit();
-				stringstream buffer;
-				buffer << "{\x22success\x22:true,\x22key\x22:" << keyPressed << ",\x22message\x22:\x22Key PRO released\x22}";
-				string responseBody = buffer.str();
-				stringstream stringStream;
-				stringStream << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << responseBody.length() << "\r\n\r\n" << responseBody;
-				response = stringStream.str();
-			}
-			else
-				response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 13\r\n\r\n{\"success\":false,\"message\":\"Bad key event\"}";
+		epoll_event event;
+		event.events = EPOLLIN | EPOLLEXCLUSIVE;
+		event.data.fd = listener;
+		if(epoll_ctl(w->epoll, EPOLL_CTL_ADD, listener, &event) < 0){
+			event.events = EPOLLIN;
+			epoll_ctl(w->epoll, EPOLL_CTL_ADD, listener, &event);
 		}
-		else{
-			response = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nError";
+		if(w->wake >= 0){
+			event.events = EPOLLIN;
+			event.data.fd = w->wake;
+			epoll_ctl(w->epoll, EPOLL_CTL_ADD, w->wake, &event);
 		}
-		
-		write(new_socket, &response[0], strlen(&response[0]));
-		close(new_socket);
+		pool.push_back(w);
 	}
-}
+	if(assets->watchFd() >= 0){
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.fd = assets->watchFd();
+		epoll_ctl(pool[0]->epoll, EPOLL_CTL_ADD, assets->watchFd(), &event);
+	}
+	
+	cout << "Type \"localhost:" << port << "/index.html\" in your browser to connect to the AGC emulator." << endl;
+	for(unsigned i=1; i<workers; i++)
+		thread(workerLoop, std::ref(agc), pool[i]).detach();
+	workerLoop(agc, pool[0]);
+}
\ No newline at end of file
@@ -16,12 +16,21 @@
 #include <cstring>
 #include <fstream>
 #include <sstream>
-#include <regex>
 
 #include "agc.h"
+#include "httpRequest.h"
 
 using namespace std;
 
-int fetchRequest(char *buffer);
-int getKey(char *buffer);
+#define GUI_PORT			8080
+#define GUI_WORKERS			4		// threads of the server, at most one per core
+#define GUI_MAX_EVENTS		64		// epoll events taken at once
+#define GUI_MAX_REQUEST		8192	// headers (or body) longer than this close the connection
+#define GUI_IDLE_TIMEOUT	30		// seconds an HTTP connection is kept open without requests
+#define GUI_KEY_GAP			20000	// MCT between two keys of POST /keys without gap= (240 ms): the ROM loses keys closer than that
+#define GUI_KEYS_TIMEOUT	60		// seconds a POST /keys waits for the CPU to take its keys, then 504
+
+int fetchRequest(const httpRequest &request);
+int getKey(const httpRequest &request);
+int keyFromChar(char c);
 void serverStart(agc &agc);
\ No newline at end of file
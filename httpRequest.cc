@@ -0,0 +1,152 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "httpRequest.h"
+
+using namespace std;
+
+bool httpSpan::is(const char *text) const {
+	return strlen(text) == length && memcmp(data, text, length) == 0;
+}
+
+bool httpSpan::isNoCase(const char *text) const {
+	return strlen(text) == length && strncasecmp(data, text, length) == 0;
+}
+
+bool httpSpan::startsWith(const char *text) const {
+	size_t n = strlen(text);
+	return n <= length && memcmp(data, text, n) == 0;
+}
+
+static bool isSpace(char c){
+	return c == ' ' || c == '\t';
+}
+
+httpSpan httpRequest::header(const char *name) const {
+	httpSpan value = {NULL, 0};
+	size_t n = strlen(name);
+	const char *line = headers.data;
+	const char *end = headers.data + headers.length;
+
+	while(line < end){
+		const char *next = (const char*)memchr(line, '\n', end - line);
+		next = next ? next + 1 : end;
+		if((size_t)(next - line) > n && line[n] == ':' && strncasecmp(line, name, n) == 0){
+			const char *first = line + n + 1;
+			const char *last = next;
+			while(first < last && isSpace(*first))
+				first++;
+			while(last > first && (isSpace(last[-1]) || last[-1] == '\r' || last[-1] == '\n'))
+				last--;
+			value.data = first;
+			value.length = last - first;
+			return value;
+		}
+		line = next;
+	}
+	return value;
+}
+
+httpSpan httpRequest::parameter(const char *name) const {
+	httpSpan value = {NULL, 0};
+	size_t n = strlen(name);
+	const char *item = query.data;
+	const char *end = query.data + query.length;
+
+	while(item < end){
+		const char *next = (const char*)memchr(item, '&', end - item);
+		if(next == NULL)
+			next = end;
+		if((size_t)(next - item) > n && item[n] == '=' && memcmp(item, name, n) == 0){
+			value.data = item + n + 1;
+			value.length = next - value.data;
+			return value;
+		}
+		item = next + 1;
+	}
+	return value;
+}
+
+int parseRequest(const char *buffer, size_t length, httpRequest &request){
+	//Request line: METHOD SP target SP HTTP/1.x CRLF
+	const char *end = buffer + length;
+	const char *p = buffer;
+
+	request.method.data = p;
+	while(p < end && *p >= 'A' && *p <= 'Z')
+		p++;
+	if(p == end)
+		return 0;
+	if(*p != ' ' || p == buffer)
+		return -1;
+	request.method.length = p - buffer;
+
+	const char *target = ++p;
+	while(p < end && *p > ' ' && *p < 0x7F)
+		p++;
+	if(p == end)
+		return 0;
+	if(*p != ' ' || p == target || *target != '/')
+		return -1;
+	const char *question = (const char*)memchr(target, '?', p - target);
+	request.path.data = target;
+	request.path.length = (question ? question : p) - target;
+	request.query.data = question ? question + 1 : p;
+	request.query.length = question ? p - question - 1 : 0;
+
+	static const char version[] = "HTTP/1.";
+	for(size_t i=0; i<sizeof(version) - 1; i++){
+		if(++p == end)
+			return 0;
+		if(*p != version[i])
+			return -1;
+	}
+	if(++p == end)
+		return 0;
+	if(*p < '0' || *p > '9')
+		return -1;
+	request.minor = *p - '0';
+	if(++p == end)
+		return 0;
+	if(*p != '\r')
+		return -1;
+	if(++p == end)
+		return 0;
+	if(*p != '\n')
+		return -1;
+
+	//Headers, up to an empty line
+	request.headers.data = ++p;
+	while(1){
+		const char *line = p;
+		const char *lf = (const char*)memchr(line, '\n', end - line);
+		if(lf == NULL)
+			return 0;
+		if(lf == line || lf[-1] != '\r')
+			return -1;
+		p = lf + 1;
+		if(lf - line == 1){//CRLF alone
+			request.headers.length = line - request.headers.data;
+			request.length = p - buffer;
+			return 1;
+		}
+	}
+}
+
+long long spanNumber(const httpSpan &span){
+	if(span.data == NULL || span.length == 0 || span.length > 18)
+		return -1;
+	long long n = 0;
+	for(size_t i=0; i<span.length; i++){
+		if(span.data[i] < '0' || span.data[i] > '9')
+			return -1;
+		n = n * 10 + (span.data[i] - '0');
+	}
+	return n;
+}
@@ -0,0 +1,40 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#pragma once
+
+#include <cstddef>
+
+using namespace std;
+
+/* bytes of the receive buffer, not copied nor terminated */
+struct httpSpan {
+	const char *data;
+	size_t length;
+
+	bool is(const char *text) const;			/* equal to text */
+	bool isNoCase(const char *text) const;
+	bool startsWith(const char *text) const;
+};
+
+/* a request parsed in place: every span points into the buffer */
+struct httpRequest {
+	httpSpan method;
+	httpSpan path;				// target up to '?'
+	httpSpan query;				// after '?', empty for none
+	int minor;					// HTTP/1.minor
+	httpSpan headers;			// header lines, each one ending with CRLF
+	size_t length;				// request line and headers, up to the empty line included
+
+	httpSpan header(const char *name) const;	/* value of a header (name in any case), trimmed; data NULL if missing */
+	httpSpan parameter(const char *name) const;	/* value of a query parameter; data NULL if missing */
+};
+
+/* request at the start of buffer: 1 parsed, 0 not all there yet, -1 not HTTP/1.x */
+int parseRequest(const char *buffer, size_t length, httpRequest &request);
+
+/* decimal number of a span, -1 if it is not one */
+long long spanNumber(const httpSpan &span);
@@ -14,40 +14,203 @@
 
 using namespace std;
 
-agc agc;
-bool verbose = false;
+static agc *machine = NULL;
+static volatile sig_atomic_t interrupted = 0;
 
+// The recording is closed by main() once emulate() returns
 void signalHandler( int signum ) {
-   cout << "\nInterrupt signal (" << signum << ") received.\n";
-   agc.debug();
-   exit(-1);  
+   interrupted = signum;
+   if(machine)
+      machine->requestStop();
+}
+
+void snapshotHandler( int signum ) {
+   if(machine)
+      machine->requestSnapshot();
 }
 
 void usage(const char *name) {
-	cerr << "Usage: " << name << " [-v]\n";
+	cerr << "Usage: " << name << " [-v] [-b] [-a] [-u] [-f] [-x factor] [-q mct] [-s file] [-r file] [-c file] [-t seconds] [-i file] [-p file]\n";
+	cerr << "  -v  verbose\n";
+	cerr << "  -b  run fixed memory through the block engine (the same machine as the interpreter, decoded once)\n";
+	cerr << "  -a  run the blocks compiled by \"make aot\"\n";
+	cerr << "  -u  skip the address checks of decode\n";
+	cerr << "  -f  do not pace the emulation to real time (same as -x 0)\n";
+	cerr << "  -x  speed factor of the virtual clock, 0 for unlimited\n";
+	cerr << "  -q  MCT run between two waits of the host clock (default " << PACING_QUANTUM << ")\n";
+	cerr << "  -s  snapshot written on SIGUSR1 (default agc.snap)\n";
+	cerr << "  -r  start from a snapshot instead of booting\n";
+	cerr << "  -c  append a checkpoint every 250 ms of mission time to a log\n";
+	cerr << "  -t  keep the last seconds of mission time to go back to after a fault (interpreter only)\n";
+	cerr << "  -i  record the DSKY inputs with their MCT\n";
+	cerr << "  -p  play inputs recorded with -i, headless and unpaced\n";
+}
+
+void timeTravel(agc &m) {
+	
+	cout << "Time travel: b n (back n steps), s n (forward n steps), w addr (back to the last write of an\n"
+		<< "erasable octal address), i (back to the last interrupt), d (debug), q (quit)\n";
+	string command;
+	while(cout << "step " << m.getSteps() << " MCT " << m.getMCT() << "> " << flush && cin >> command){
+		bool done = true;
+		long unsigned n = 1;
+		if(command == "q")
+			break;
+		else if(command == "d")
+			m.debug();
+		else if(command == "b" || command == "s"){
+			if(cin.peek() != '\n')
+				cin >> n;
+			done = (command == "b") ? m.stepBack(n) : m.travel(m.getSteps() + n);
+		}
+		else if(command == "w"){
+			cin >> oct >> n >> dec;
+			done = m.lastWrite(n);
+		}
+		else if(command == "i")
+			done = m.lastInterrupt();
+		else
+			cout << "Unknown command " << command << endl;
+		if(!done){
+			int e = m.getFault();
+			if(e != NO_FAULT)
+				cout << "\tEXCEPTION: " << agc::exceptionName(e) << endl;
+			else
+				cout << "Not in the history" << endl;
+		}
+		cout << m.getRegisters() << endl;
+	}
+	
 }
 
 int main(int argc, char *argv[]){
 	
 	char ch;
+	agcOptions options;
+	const char *resume = NULL;
+	const char *log = NULL;
+	long unsigned history = 0;
+	const char *record = NULL;
+	const char *play = NULL;
 	
-	signal(SIGINT, signalHandler);
+	signal(SIGUSR1, snapshotHandler);
 	
-	while ( (ch = getopt(argc, argv, "advns:rb")) != -1) {
+	while ( (ch = getopt(argc, argv, "advns:r:c:t:i:p:bufx:q:")) != -1) {
 		switch (ch) {
 			case 'v':
-				verbose = true;
+				options.verbose = true;
+				break;
+			case 'b':
+				options.blockEngine = true;
+				break;
+			case 'a':
+				options.aotEngine = true;
+				break;
+			case 'u':
+				options.boundsChecks = false;
+				break;
+			case 'f':
+				options.pacing = false;
+				break;
+			case 'x':
+				options.speed = atof(optarg);
+				if(options.speed < 0){
+					usage(argv[0]);
+					return 1;
+				}
+				options.pacing = (options.speed > 0);
+				break;
+			case 'q':
+				options.quantum = atol(optarg);
+				if(options.quantum == 0){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's':
+				options.snapshot = optarg;
+				break;
+			case 'r':
+				resume = optarg;
+				break;
+			case 'c':
+				log = optarg;
+				break;
+			case 't':
+				history = atol(optarg);
+				if(history == 0){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'i':
+				record = optarg;
+				break;
+			case 'p':
+				play = optarg;
 				break;
 			default:
-				usage(argv[1]);
+				usage(argv[0]);
 				return 1;
 		}
 	}
+	if(play){
+		options.headless = true;
+		options.pacing = false;
+	}
 	
-	thread guiThread(serverStart, std::ref(agc));
-	agc.emulate();
-	guiThread.join();
+	machine = new agc(options);
+	if(resume && !machine->loadSnapshot(resume)){
+		cerr << "Cannot load snapshot " << resume << endl;
+		return 1;
+	}
+	if(log && !machine->startCheckpoints(log)){
+		cerr << "Cannot create checkpoint log " << log << endl;
+		return 1;
+	}
+	if(history)
+		machine->startHistory(history);
+	if(record && !machine->recordInputs(record)){
+		cerr << "Cannot create input record " << record << endl;
+		return 1;
+	}
+	long unsigned end = ULONG_MAX;
+	if(play && !machine->replayInputs(play, end)){
+		cerr << "Cannot read inputs " << play << endl;
+		return 1;
+	}
+	signal(SIGINT, signalHandler);
+	thread guiThread;
+	if(!play)
+		guiThread = thread(serverStart, std::ref(*machine));
 	
-	return 0;
+	// emulate() returns only when the machine stops on a fault (or at the end of a replay)
+	auto start = chrono::steady_clock::now();
+	long unsigned first = machine->getMCT();
+	int e = machine->emulate(end);
+	signal(SIGINT, SIG_DFL);
+	if(interrupted){
+		cout << "\nInterrupt signal (" << interrupted << ") received.\n";
+		machine->debug();
+		machine->stopRecording();
+		machine->stopCheckpoints();
+		exit(-1);
+	}
+	if(e == NO_FAULT){
+		double wall = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count() / 1000.0;
+		cout << "Replay ended at MCT " << machine->getMCT() << " in " << wall << " ms ("
+			<< (wall > 0 ? (machine->getMCT() - first) * CYCLE_PERIOD / 1000.0 / wall : 0) << "x real time)\n";
+		cout << machine->getRegisters() << endl << machine->getDSKYStatus() << endl;
+		machine->stopRecording();
+		machine->stopCheckpoints();
+		return 0;
+	}
+	cout << "\tEXCEPTION: " << agc::exceptionName(e);
+	machine->debug();
+	machine->stopRecording();
+	machine->stopCheckpoints();
+	if(history)
+		timeTravel(*machine);
+	exit(-1);
 
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string.h>
+
+using namespace std;
+
+/*
+ *	Value written by one thread and read by any number of others, no locks.
+ *	The writer makes sequence odd, stores the words and makes it even again;
+ *	a reader copies the words and tries again if sequence was odd or moved
+ *	meanwhile. The writer never waits. The words are atomics, so a torn copy
+ *	is thrown away, never undefined. T is plain data, a multiple of 8 bytes.
+ */
+template<class T>
+class seqlock
+{
+private:
+	static const size_t WORDS = sizeof(T) / sizeof(uint64_t);
+	static_assert(sizeof(T) % sizeof(uint64_t) == 0, "T must be a multiple of 8 bytes");
+
+	atomic<uint64_t> sequence;		// twice the number of values published, odd while writing
+	atomic<uint64_t> words[WORDS];
+
+	void copy(const seqlock &source){
+		uint64_t version;
+		T value = source.read(version);
+		sequence.store(version * 2, memory_order_relaxed);
+		store(value);
+	}
+
+	void store(const T &value){
+		uint64_t w[WORDS];
+		memcpy(w, &value, sizeof(T));
+		for(size_t i=0; i<WORDS; i++)
+			words[i].store(w[i], memory_order_relaxed);
+	}
+
+public:
+	seqlock() : sequence(0) {
+		for(size_t i=0; i<WORDS; i++)
+			words[i].store(0, memory_order_relaxed);
+	}
+	seqlock(const seqlock &source){ copy(source); }
+	seqlock& operator=(const seqlock &source){ copy(source); return *this; }
+
+	/* writer only: version goes up by one */
+	void publish(const T &value){
+		uint64_t s = sequence.load(memory_order_relaxed);
+		sequence.store(s + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		store(value);
+		sequence.store(s + 2, memory_order_release);
+	}
+
+	/* any thread: the last value published and its version (0 before the first) */
+	T read(uint64_t &version) const {
+		uint64_t w[WORDS];
+		uint64_t before, after;
+		do{
+			before = sequence.load(memory_order_acquire);
+			for(size_t i=0; i<WORDS; i++)
+				w[i] = words[i].load(memory_order_relaxed);
+			atomic_thread_fence(memory_order_acquire);
+			after = sequence.load(memory_order_relaxed);
+		}while((before & 1) || before != after);
+		T value;
+		memcpy(&value, w, sizeof(T));
+		version = before / 2;
+		return value;
+	}
+
+};
@@ -0,0 +1,66 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+/*
+ *	Bounded ring between one producer and one consumer, no locks.
+ *	SIZE is a power of two; head and tail run free and wrap on their own,
+ *	the slot is the index modulo SIZE. The producer owns tail, the consumer
+ *	head: each one only reads the other's with acquire, and publishes its
+ *	own with release once the slot is written (or read).
+ */
+template<class T, uint32_t SIZE>
+class spscQueue
+{
+private:
+	static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+	T slots[SIZE];
+	atomic<uint32_t> head;				// next slot to read, written by the consumer
+	char apart[64];						// head and tail on two cache lines
+	atomic<uint32_t> tail;				// next slot to write, written by the producer
+
+public:
+	spscQueue() : head(0), tail(0) {}
+	spscQueue(const spscQueue&) = delete;
+	spscQueue& operator=(const spscQueue&) = delete;
+
+	/* producer: false when full */
+	bool push(const T &item){
+		uint32_t t = tail.load(memory_order_relaxed);
+		if(t - head.load(memory_order_acquire) == SIZE)
+			return false;
+		slots[t & (SIZE - 1)] = item;
+		tail.store(t + 1, memory_order_release);
+		return true;
+	}
+
+	/* producer: free slots, at least that many push() succeed */
+	uint32_t space(){
+		return SIZE - (tail.load(memory_order_relaxed) - head.load(memory_order_acquire));
+	}
+
+	/* consumer: copies the oldest item without taking it, false when empty */
+	bool front(T &item){
+		uint32_t h = head.load(memory_order_relaxed);
+		if(h == tail.load(memory_order_acquire))
+			return false;
+		item = slots[h & (SIZE - 1)];
+		return true;
+	}
+
+	/* consumer: drops the item read by front() */
+	void pop(){
+		head.store(head.load(memory_order_relaxed) + 1, memory_order_release);
+	}
+
+};
@@ -0,0 +1,77 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+/*
+ * A machine given back to an agcPool is handed out again in the state of
+ * the source, and runs as a fresh clone of it does.
+ */
+
+#include <iostream>
+
+#include "agcPool.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what){
+	if(!ok){
+		cerr << "FAIL: " << what << endl;
+		failures++;
+	}
+}
+
+static bool same(agc &a, agc &b){
+	return a.stateHash() == b.stateHash() && a.getRegisters() == b.getRegisters() && a.getDSKYStatus() == b.getDSKYStatus();
+}
+
+/* V35E, then runs to mct */
+static void dirty(agc &m, long unsigned mct){
+	const uint16_t keys[] = {KEY_VERB, KEY_3, KEY_5, KEY_ENTR};
+	for(int i=0; i<4; i++){
+		m.dskyInput(keys[i]);
+		m.emulate(m.getMCT() + 40000);
+	}
+	m.emulate(mct);
+}
+
+int main(){
+
+	agcOptions options;
+	options.headless = true;
+	options.pacing = false;
+	agc base(options);
+	base.emulate(200000);
+	long unsigned start = base.getMCT();
+
+	// Nothing made ahead: the second acquire() can only be the machine released
+	agcPool pool(base, 0);
+	agcOptions run = options;
+	run.blockEngine = true;//fills the block cache too
+	agc *m = pool.acquire(run);
+	check(m->getMCT() == start, "a clone starts at the MCT of the source");
+	dirty(*m, start + 1000000);
+	check(m->getMCT() > start, "the clone ran");
+	m->dskyInput(KEY_RSET);//still queued when it is given back
+	pool.release(m);
+
+	agc *again = pool.acquire(run);
+	agc fresh(base, run);
+	check(again == m, "a released machine is handed out again");
+	check(again->getMCT() == start, "reset to the MCT of the source");
+	check(same(*again, fresh), "reset to the state of the source");
+
+	// Same run from there: no input, decoded word or block of the last job is left
+	dirty(*again, start + 2000000);
+	dirty(fresh, start + 2000000);
+	check(same(*again, fresh), "runs as a fresh clone");
+
+	pool.release(again);
+	if(failures == 0)
+		cout << "agcPoolTest: ok" << endl;
+	return failures ? 1 : 0;
+
+}
@@ -0,0 +1,124 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+/*
+ * Time of the routing of a request: the std::regex fetchRequest()/getKey()
+ * the server had, on a NUL terminated copy of the headers, against
+ * parseRequest() and the span based ones of guiServer.cc.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <regex>
+#include <string>
+
+#include "guiServer.h"
+
+using namespace std;
+
+/* the old ones, as they were in guiServer.cc */
+static int regexFetchRequest(char *buffer){
+	const regex index_template("(GET \\/(index\\.html)? HTTP\\/\\d\\.\\d)");
+	const regex status_template("(GET \\/status(\\?since=\\d+)? HTTP\\/\\d\\.\\d)");
+	const regex keypress_template("(GET \\/button\\/[a-z0-9]{1} HTTP\\/\\d\\.\\d)");
+	const regex websocket_template("(GET \\/ws HTTP\\/\\d\\.\\d)");
+
+	string request(buffer);
+
+	smatch m;
+	regex_search(request, m, index_template);
+	if(!m.empty() && m[0].matched)
+		return 1;
+	regex_search(request, m, status_template);
+	if(!m.empty() && m[0].matched)
+		return 2;
+	regex_search(request, m, keypress_template);
+	if(!m.empty() && m[0].matched)
+		return 3;
+	regex_search(request, m, websocket_template);
+	if(!m.empty() && m[0].matched)
+		return 4;
+	return 0;
+}
+
+static int regexGetKey(char *buffer){
+	const regex key_template("(GET \\/button\\/)([a-z0-9]{1})");
+
+	string request(buffer);
+
+	smatch m;
+	regex_search(request, m, key_template);
+	if(!m.empty() && m[0].matched && m[2].matched)
+		return keyFromChar(m[2].str()[0]);
+	return 0;
+}
+
+/* what a browser sends: the headers are most of the bytes */
+static const char *requests[] = {
+	"GET /index.html HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+		"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nAccept-Language: en-US,en;q=0.5\r\n"
+		"Accept-Encoding: gzip, deflate, br\r\nConnection: keep-alive\r\n\r\n",
+	"GET /status?since=1234 HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+		"Accept: */*\r\nAccept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate, br\r\nIf-None-Match: \"5.1234\"\r\nConnection: keep-alive\r\n\r\n",
+	"GET /button/v HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+		"Accept: */*\r\nAccept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate, br\r\nConnection: keep-alive\r\n\r\n",
+	"GET /ws HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+		"Upgrade: websocket\r\nConnection: keep-alive, Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n",
+};
+
+static const int REQUESTS = sizeof(requests) / sizeof(requests[0]);
+
+int main(int argc, char *argv[]){
+
+	// The regex path is thousands of times slower: it gets fewer rounds
+	long rounds = (argc > 1) ? atol(argv[1]) : 250;
+	long spanRounds = rounds * 1000;
+
+	// Both ways must route the same before they are timed
+	for(int i=0; i<REQUESTS; i++){
+		string copy = requests[i];
+		httpRequest request;
+		if(parseRequest(requests[i], strlen(requests[i]), request) != 1 || fetchRequest(request) != regexFetchRequest(&copy[0])
+			|| (fetchRequest(request) == 3 && getKey(request) != regexGetKey(&copy[0]))){
+			cerr << "FAIL: request " << i << " is not routed the same" << endl;
+			return 1;
+		}
+	}
+
+	long routed = 0;
+	auto start = chrono::steady_clock::now();
+	for(long n=0; n<rounds; n++){
+		for(int i=0; i<REQUESTS; i++){
+			string copy = requests[i];//the server copied the headers to terminate them
+			int type = regexFetchRequest(&copy[0]);
+			if(type == 3)
+				type += regexGetKey(&copy[0]);
+			routed += type;
+		}
+	}
+	double regexNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / (double)(rounds * REQUESTS);
+
+	start = chrono::steady_clock::now();
+	for(long n=0; n<spanRounds; n++){
+		for(int i=0; i<REQUESTS; i++){
+			httpRequest request;
+			int type = 0;
+			if(parseRequest(requests[i], strlen(requests[i]), request) == 1)
+				type = fetchRequest(request);
+			if(type == 3)
+				type += getKey(request);
+			routed -= (n < rounds) ? type : 0;
+		}
+	}
+	double spanNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / (double)(spanRounds * REQUESTS);
+
+	cout << fixed;
+	cout.precision(1);
+	cout << "std::regex:     " << regexNs << " ns/request" << endl;
+	cout << "parseRequest(): " << spanNs << " ns/request (" << regexNs / spanNs << "x)" << endl;
+	return routed == 0 ? 0 : 1;
+
+}
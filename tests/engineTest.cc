@@ -0,0 +1,108 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+/*
+ * The block engine is the same machine as the interpreter: the same keys,
+ * replayed at their MCT in the middle of blocks, give the same state at
+ * every stop, and a stop on Z inside a block is taken at the same word.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <stdlib.h>
+
+#include "agc.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what){
+	if(!ok){
+		cerr << "FAIL: " << what << endl;
+		failures++;
+	}
+}
+
+static bool same(agc &a, agc &b){
+	return a.getMCT() == b.getMCT() && a.getSteps() == b.getSteps() && a.stateHash() == b.stateHash()
+		&& a.getRegisters() == b.getRegisters() && a.getDSKYStatus() == b.getDSKYStatus();
+}
+
+/* V35E, V16N36E and V37E, keys an odd number of MCT apart */
+static bool writeInputs(const char *path){
+	const int sequences[][8] = {
+		{KEY_VERB, KEY_3, KEY_5, KEY_ENTR},
+		{KEY_VERB, KEY_1, KEY_6, KEY_NOUN, KEY_3, KEY_6, KEY_ENTR},
+		{KEY_VERB, KEY_3, KEY_7, KEY_ENTR},
+	};
+	const long unsigned starts[] = {1000000, 2500000, 4000000};
+	ofstream file(path, ios::trunc);
+	file << INPUT_MAGIC << "\n";
+	for(int s=0; s<3; s++){
+		for(int i=0; i<8 && sequences[s][i]; i++){
+			file << starts[s] + i * 30011 << " key " << sequences[s][i] << "\n";
+		}
+	}
+	file << 6000000 << " end 0\n";
+	return (bool) file;
+}
+
+int main(){
+
+	char path[] = "/tmp/engineTestXXXXXX";
+	int fd = mkstemp(path);
+	if(fd < 0 || !writeInputs(path)){
+		cerr << "Cannot write " << path << endl;
+		return 1;
+	}
+	close(fd);
+
+	agcOptions options;
+	options.headless = true;
+	options.pacing = false;
+	agc interpreter(options);
+	options.blockEngine = true;
+	agc blocks(options);
+	long unsigned end, blocksEnd;
+	check(interpreter.replayInputs(path, end) && blocks.replayInputs(path, blocksEnd), "inputs loaded");
+	unlink(path);
+
+	// Stops at odd MCT fall inside blocks too
+	bool equal = true;
+	for(long unsigned mct = 99991; equal && mct < end; mct += 99991){
+		int a = interpreter.emulate(mct);
+		int b = blocks.emulate(mct);
+		equal = (a == b) && same(interpreter, blocks);
+	}
+	check(equal, "same state at every stop");
+	interpreter.emulate(end);
+	blocks.emulate(end);
+	check(same(interpreter, blocks), "same state at the end of the inputs");
+	check(interpreter.getMCT() >= end && interpreter.getMCT() < end + 10, "stops at the first word after the MCT asked");
+
+	// Addresses inside the first blocks after boot, as agc-batch z=2093 ... z=2104
+	int reached = 0;
+	equal = true;
+	for(int z = 2093; z <= 2104; z++){
+		agcOptions run = options;
+		run.blockEngine = false;
+		agc a(run);
+		run.blockEngine = true;
+		agc b(run);
+		a.emulate(200000, z);
+		b.emulate(200000, z);
+		reached += (a.getStopReason() == STOP_Z);
+		equal = equal && a.getStopReason() == b.getStopReason() && same(a, b);
+	}
+	check(reached == 10, "Z reached in the boot code");
+	check(equal, "same stop on Z");
+
+	if(failures == 0)
+		cout << "engineTest: ok" << endl;
+	return failures ? 1 : 0;
+
+}
@@ -0,0 +1,161 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+/*
+ * parseRequest() on arbitrary bytes, as a client of the GUI can send them.
+ * With LIBFUZZER defined this is a libFuzzer target; otherwise main() runs
+ * the files given (one input each, as AFL does with @@) or, with none,
+ * random mutations of a few requests. Built with the sanitizers by "make fuzz".
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#include "httpRequest.h"
+
+using namespace std;
+
+static void fail(const char *what){
+	cerr << "FAIL: " << what << endl;
+	abort();
+}
+
+static void inside(const httpSpan &span, const char *buffer, size_t length, const char *what){
+	if(span.data == NULL)
+		return;
+	if(span.data < buffer || span.length > length || span.data + span.length > buffer + length)
+		fail(what);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+	//An exact copy: the sanitizers catch a read one byte past the end
+	char *buffer = new char[size ? size : 1];
+	memcpy(buffer, data, size);
+
+	httpRequest request;
+	int result = parseRequest(buffer, size, request);
+	if(result < -1 || result > 1)
+		fail("result is 1, 0 or -1");
+	if(result == 1){
+		if(request.length > size)
+			fail("request longer than the buffer");
+		inside(request.method, buffer, request.length, "method");
+		inside(request.path, buffer, request.length, "path");
+		inside(request.query, buffer, request.length, "query");
+		inside(request.headers, buffer, request.length, "headers");
+		if(request.minor < 0 || request.minor > 9)
+			fail("minor version");
+
+		const char *names[] = {"Host", "Connection", "Accept-Encoding", "If-None-Match", "Sec-WebSocket-Key", "Content-Length", ""};
+		for(size_t i=0; i<sizeof(names) / sizeof(names[0]); i++){
+			inside(request.header(names[i]), buffer, request.length, "header");
+		}
+		const char *parameters[] = {"gap", "since", ""};
+		for(size_t i=0; i<sizeof(parameters) / sizeof(parameters[0]); i++){
+			httpSpan value = request.parameter(parameters[i]);
+			inside(value, buffer, request.length, "parameter");
+			long long n = spanNumber(value);
+			if(n < -1)
+				fail("spanNumber");
+		}
+		request.method.is("GET");
+		request.path.startsWith("/button/");
+		request.header("Connection").isNoCase("close");
+
+		//What the server has before the last byte is not all there yet
+		httpRequest prefix;
+		if(parseRequest(buffer, request.length - 1, prefix) != 0)
+			fail("a prefix of a request is not all there");
+	}
+
+	delete[] buffer;
+	return 0;
+}
+
+#ifndef LIBFUZZER
+
+static const char *seeds[] = {
+	"GET / HTTP/1.1\r\nHost: localhost:8080\r\n\r\n",
+	"GET /index.html HTTP/1.1\r\nHost: localhost:8080\r\nAccept-Encoding: gzip, deflate\r\nIf-None-Match: \"1f2e3d\"\r\n\r\n",
+	"GET /status?since=42 HTTP/1.1\r\nHost: localhost:8080\r\nIf-None-Match: \"7.42\"\r\n\r\n",
+	"GET /button/v HTTP/1.0\r\n\r\n",
+	"GET /ws HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n",
+	"POST /keys?gap=20000 HTTP/1.1\r\nContent-Length: 4\r\nConnection: close\r\n\r\nV35E",
+};
+
+static uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next(){
+	//xorshift64: the same inputs on every run
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+static string mutate(string input){
+	static const char tokens[] = "\r\n :?&=/";
+	int changes = 1 + next() % 8;
+	for(int i=0; i<changes; i++){
+		size_t at = input.empty() ? 0 : next() % input.size();
+		switch(next() % 6){
+			case 0:
+				if(!input.empty())
+					input[at] = (char)next();
+				break;
+			case 1:
+				input.insert(at, 1, tokens[next() % (sizeof(tokens) - 1)]);
+				break;
+			case 2:
+				if(!input.empty())
+					input.erase(at, 1 + next() % 4);
+				break;
+			case 3:
+				input.resize(at);
+				break;
+			case 4:
+				input.insert(at, seeds[next() % (sizeof(seeds) / sizeof(seeds[0]))]);
+				break;
+			case 5:
+				if(!input.empty())
+					input[at] ^= 1 << (next() % 8);
+				break;
+		}
+	}
+	return input;
+}
+
+int main(int argc, char *argv[]){
+
+	if(argc > 1 && atol(argv[1]) == 0){
+		for(int i=1; i<argc; i++){
+			ifstream file(argv[i], ios::binary);
+			stringstream data;
+			data << file.rdbuf();
+			string input = data.str();
+			LLVMFuzzerTestOneInput((const uint8_t*)input.data(), input.size());
+		}
+		cout << "fuzzRequest: " << (argc - 1) << " files ok" << endl;
+		return 0;
+	}
+
+	long iterations = (argc > 1) ? atol(argv[1]) : 1000000;
+	for(long i=0; i<iterations; i++){
+		string input = mutate(seeds[i % (sizeof(seeds) / sizeof(seeds[0]))]);
+		LLVMFuzzerTestOneInput((const uint8_t*)input.data(), input.size());
+	}
+	cout << "fuzzRequest: " << iterations << " inputs ok" << endl;
+	return 0;
+
+}
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+/*
+ * agc-translate: builds the ROM exactly as boot() does, recovers the
+ * control flow of fixed-fixed memory starting from the BIOS and the
+ * interrupt vectors, and writes on stdout a C++ unit with one function
+ * per basic block. Blocks are the same ones the block engine translates,
+ * so a compiled block and execBlock() leave the machine in the same state.
+ * Code in erasable or banked memory and targets known only at run time
+ * (INDEX, RETURN, RESUME, DXCH Z, TS Z, ...) are left to the interpreter.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <set>
+#include <utility>
+
+#include "agc.h"
+
+using namespace std;
+
+static const char *names[] = {
+	"XXALQ", "XLQ", "RETURN", "RELINT", "INHINT", "EXTEND", "TC", "CCS", "TCF", "DAS", "LXCH",
+	"INCR", "ADS", "CA", "CS", "RESUME", "INDEX", "DXCH", "TS", "XCH", "AD", "MASK",
+	"READ", "WRITE", "RAND", "WAND", "ROR", "WOR", "RXOR", "DV", "BZF", "MSU", "QXCH",
+	"AUG", "DIM", "DCA", "DCS", "INDEX", "SU", "BZMF", "MP", "ALT"
+};
+
+static string hex16(uint16_t value){
+	stringstream s;
+	s << "0x" << hex << uppercase << setw(4) << setfill('0') << value;
+	return s.str();
+}
+
+/* C++ statements equivalent to exec() for a decoded word */
+static string emit(const decodedWord &op){
+
+	const string K = hex16(op.addr);
+	const string K1 = hex16(op.addr + 2);
+	const uint16_t k = op.addr >> 1;
+	stringstream c;
+
+	if(op.opcode >= READ)
+		c << "m.unsetExtended(); ";
+
+	switch(op.opcode){
+		case XXALQ:		c << "m.Q = m.Z; m.Z = 0xFFFE;"; break;
+		case XLQ:		c << "m.Q = m.Z; m.Z = 0;"; break;
+		case RETURN:	c << "m.Z = m.Q;"; break;
+		case RELINT:	c << "m.unmaskInterrupt();"; break;
+		case INHINT:	c << "m.maskInterrupt();"; break;
+		case EXTEND:	c << "m.setExtended();"; break;
+		case TC:		c << "m.Q = m.Z; m.Z = aluSub(" << K << ", 2).value;"; break;
+		case CCS:
+			c << "m.unsetOverflow(); m.A = m.loadWord(" << K << ");\n"
+			  << "\t\tif(m.getSign(m.A) == 0){ if(m.getValue(m.A) > 0) m.A = m.latch(aluSub(m.A, 2)); else { m.Z += 2; m.A = 0; } }\n"
+			  << "\t\telse { if(m.getValue(m.A) > 0){ m.Z += 6; m.A = m.latch(aluSub(m.getValue(m.A), 2)); } else { m.Z += 8; m.A = 0; } }";
+			break;
+		case TCF:		c << "m.Z = aluSub(" << K << ", 2).value;"; break;
+		case DAS:
+			c << "m.unsetOverflow(); m.A = m.latch(aluAdd(m.A, m.loadWord(" << K << "))); m.storeWord(" << K << ", m.A);\n"
+			  << "\t\tm.L = m.latch(aluAdd(m.L, m.loadWord(" << K1 << "))); m.storeWord(" << K1 << ", m.L);";
+			break;
+		case LXCH:
+			if(k == 7)
+				c << "m.L = m.ZR;";
+			else
+				c << "{ uint16_t temp = m.loadWord(" << K << "); m.storeWord(" << K << ", m.L); m.L = temp; }";
+			break;
+		case INCR:		c << "m.storeWord(" << K << ", m.latch(aluAdd(m.loadWord(" << K << "), 2)));"; break;
+		case ADS:		c << "m.A = m.latch(aluAdd(m.A, m.loadWord(" << K << "))); m.storeWord(" << K << ", m.A);"; break;
+		case CA:
+			if(op.addr == 0)
+				c << "// NOOP";
+			else
+				c << "m.unsetOverflow(); m.A = m.loadWord(" << K << ");";
+			break;
+		case CS:
+			if(op.addr == 0)
+				c << "m.unsetOverflow(); m.A = ~m.A; m.SIGN = (m.OW == 1) ? (~m.SIGN) : m.SIGN;";
+			else
+				c << "m.unsetOverflow(); m.A = ~m.loadWord(" << K << ");";
+			break;
+		case RESUME:
+			c << "m.A = m.ARUPT; m.L = m.LRUPT; m.Q = m.QRUPT; m.BB = m.BBRUPT; m.Z = m.ZRUPT; m.mapBanks(); m.unmaskInterrupt();";
+			break;
+		case INDEX:		c << "m.setIndex(); m.B = m.loadWord(" << K << ");"; break;
+		case DXCH:
+			if(k == 1)
+				c << "{ uint16_t temp = m.Q; m.Q = m.L; m.L = m.A; m.A = temp; }";
+			else if(k == 4)
+				c << "{ uint16_t temp = m.A; m.A = m.FB; m.FB = temp; temp = m.L; m.L = m.Z; m.Z = temp; m.mapBanks(); }";
+			else if(k == 5)
+				c << "{ uint16_t temp = m.A; m.A = m.Z; m.Z = temp; temp = m.L; m.L = m.BB; m.BB = temp; m.mapBanks(); }";
+			else
+				c << "{ uint16_t temp = m.A; m.A = m.loadWord(" << K << "); m.storeWord(" << K << ", temp);\n"
+				  << "\t\ttemp = m.L; m.L = m.loadWord(" << K1 << "); m.storeWord(" << K1 << ", temp); }";
+			break;
+		case TS:
+			if(op.addr == 0)
+				c << "if(m.OW) m.Z += 2; else m.storeWord(" << K << ", m.A);";
+			else if(k == 5)
+				c << "m.Z = m.A & 0x1FFE; if(m.OW){ m.A = m.SIGN ? 0x0002 : 0xFFFC; m.Z += 2; }";
+			else
+				c << "if(m.OW){ m.storeWord(" << K << ", m.SIGN | m.getValue(m.A)); m.A = m.SIGN ? 0x0002 : 0xFFFC; m.Z += 2; }\n"
+				  << "\t\telse m.storeWord(" << K << ", m.A);";
+			c << "\n\t\tm.unsetOverflow();";
+			break;
+		case XCH:		c << "{ uint16_t temp = m.A; m.A = m.loadWord(" << K << "); m.storeWord(" << K << ", temp); }"; break;
+		case AD:
+			if(op.addr == 0)
+				c << "m.A = m.latch(aluAdd(m.A, m.A));";
+			else
+				c << "m.A = m.latch(aluAdd(m.A, m.loadWord(" << K << ")));";
+			break;
+		case MASK:		c << "m.A &= m.loadWord(" << K << ");"; break;
+		case READ:		c << "m.A = m.loadWordIO(" << K << ");"; break;
+		case WRITE:		c << "m.storeWordIO(" << K << ", m.A);"; break;
+		case RAND:		c << "m.A = m.A & m.loadWordIO(" << K << ");"; break;
+		case WAND:		c << "m.A = m.A & m.loadWordIO(" << K << "); m.storeWordIO(" << K << ", m.A);"; break;
+		case ROR:		c << "m.A = m.A | m.loadWordIO(" << K << ");"; break;
+		case WOR:		c << "m.storeWordIO(" << K << ", m.A | m.loadWordIO(" << K << "));"; break;
+		case RXOR:		c << "m.A = m.A ^ m.loadWordIO(" << K << ");"; break;
+		case ALT:		c << "throw ALT;"; break;
+		case DV:		c << "m.isEditing(); m.unsetOverflow(); { uint16_t temp = m.loadWord(" << K << "); if(aluDivByZero(temp)) throw NO_DIVISION; m.latch(aluDiv(m.A, m.L, temp)); }"; break;
+		case BZF:		c << "if(m.A == 0) m.Z = aluSub(" << K << ", 2).value;"; break;
+		case MSU:		c << "m.unsetOverflow(); m.A = fromInt15((m.A >> 1) - (m.loadWord(" << K << ") >> 1));"; break;
+		case QXCH:
+			if(k == 7)
+				c << "m.Q = m.ZR;";
+			else
+				c << "{ uint16_t temp = m.loadWord(" << K << "); m.storeWord(" << K << ", m.Q); m.Q = temp; }";
+			break;
+		case AUG:
+			c << "if(m.getSign(m.loadWord(" << K << ")) == 0) m.storeWord(" << K << ", m.latch(aluAdd(m.loadWord(" << K << "), 2)));\n"
+			  << "\t\telse m.storeWord(" << K << ", m.latch(aluSub(m.loadWord(" << K << "), 2)));";
+			break;
+		case DIM:
+			c << "if(m.getSign(m.loadWord(" << K << ")) == 0 && m.getValue(m.loadWord(" << K << ")) > 0) m.storeWord(" << K << ", m.latch(aluSub(m.loadWord(" << K << "), 2)));\n"
+			  << "\t\telse if(m.getSign(m.loadWord(" << K << ")) == 1 && m.getValue(m.loadWord(" << K << ")) > 0) m.storeWord(" << K << ", m.latch(aluAdd(m.loadWord(" << K << "), 2)));";
+			break;
+		case DCA:		c << "m.unsetOverflow(); m.A = m.loadWord(" << K << "); m.L = m.loadWord(" << K1 << ");"; break;
+		case DCS:
+			if(op.addr == 0)
+				c << "m.unsetOverflow(); m.A = ~m.A; m.L = ~m.L;";
+			else
+				c << "m.unsetOverflow(); m.A = ~m.loadWord(" << K << "); m.L = ~m.loadWord(" << K1 << ");";
+			break;
+		case INDEX_EXT:	c << "m.setExtended(); m.Z = m.latch(aluAdd(m.Z, m.latch(aluSub(m.loadWord(" << K << "), (1 << 1)))));"; break;
+		case SU:		c << "m.A = m.latch(aluSub(m.A, m.loadWord(" << K << ")));"; break;
+		case BZMF:		c << "if(m.getSign(m.A) == 1) m.Z = m.latch(aluSub(m.loadWord(" << K << "), (1 << 1)));"; break;
+		case MP:
+			if(op.addr == 0)
+				c << "m.isEditing(); m.unsetOverflow(); m.latch(aluMul(m.A, m.A));";
+			else
+				c << "m.isEditing(); m.unsetOverflow(); m.latch(aluMul(m.A, m.loadWord(" << K << ")));";
+			break;
+	}
+
+	return c.str();
+
+}
+
+/* addresses where execution may continue after a block, when known statically */
+static void successors(uint16_t start, const agcBlock &block, vector<pair<uint16_t, bool> > &next){
+
+	const decodedWord &op = block.code.back();
+	uint16_t last = start + block.code.size() - 1;
+	uint16_t k = op.addr >> 1;
+
+	switch(op.opcode){
+		case TC:
+			next.push_back(make_pair(k, false));
+			next.push_back(make_pair(last + 1, false));	// RETURN
+			break;
+		case TCF:
+			next.push_back(make_pair(k, false));
+			break;
+		case BZF:
+			next.push_back(make_pair(k, false));
+			next.push_back(make_pair(last + 1, false));
+			break;
+		case CCS:
+			next.push_back(make_pair(last + 1, false));
+			next.push_back(make_pair(last + 2, false));
+			next.push_back(make_pair(last + 4, false));
+			next.push_back(make_pair(last + 5, false));
+			break;
+		case TS:
+			if(k != 5){
+				next.push_back(make_pair(last + 1, false));
+				next.push_back(make_pair(last + 2, false));
+			}
+			break;
+		case INDEX:
+			next.push_back(make_pair(last + 2, false));	// last + 1 is indexed, interpreted
+			break;
+		case DXCH:
+			if(k != 4 && k != 5)
+				next.push_back(make_pair(last + 1, false));
+			break;
+		case XXALQ:
+		case XLQ:
+		case RETURN:
+		case RESUME:
+		case INDEX_EXT:
+		case BZMF:
+		case ALT:
+			break;
+		default:
+			if(op.opcode > EXTEND && k == 5)
+				break;
+			next.push_back(make_pair(last + 1, op.opcode == EXTEND));
+	}
+
+}
+
+int main(){
+
+	agc m;
+
+	// Entry points: reset and the interrupt vectors present in the IDT
+	vector<pair<uint16_t, bool> > work;
+	work.push_back(make_pair(BIOS, false));
+	for(int type = 0; type < 44; type += 4){
+		uint16_t addr = 0x1000 | (type << 1);
+		if(m.loadWord(addr))
+			work.push_back(make_pair(m.loadWord(addr + 6) >> 1, false));
+	}
+
+	set<pair<uint16_t, bool> > seen;
+	vector<pair<uint16_t, bool> > blocks;
+	stringstream code;
+
+	while(!work.empty()){
+		pair<uint16_t, bool> entry = work.back();
+		work.pop_back();
+		if(entry.first < 2048 || entry.first >= 4096 || seen.count(entry))
+			continue;
+		seen.insert(entry);
+
+		if(entry.second)
+			m.setExtended();
+		else
+			m.unsetExtended();
+		agcBlock *block = m.translate(entry.first << 1);
+		if(!block)
+			continue;
+		blocks.push_back(entry);
+		successors(entry.first, *block, work);
+
+		code << "\tstatic void b" << entry.first << (entry.second ? "x" : "") << "(agc &m){\n";
+		for(size_t i = 0; i < block->code.size(); i++){
+			const decodedWord &op = block->code[i];
+			code << "\t\t// " << (entry.first + i) << ": " << names[op.opcode];
+			if(op.opcode > EXTEND)
+				code << " " << (op.addr >> 1);
+			code << "\n";
+			code << "\t\tm.S = " << hex16(op.word) << "; m.OPCODE = " << (int) op.opcode << ";";
+			if(op.opcode > EXTEND)
+				code << " m.ADDR = " << hex16(op.addr) << ";";
+			code << " m.setMCT(" << (int) op.mct << ");";
+			code << "\n\t\t" << emit(op) << "\n";
+			if(i + 1 == block->code.size())
+				code << "\t\tm.blockExit();\n";
+			else
+				code << "\t\tif(!m.blockStep()) return;\n";
+		}
+		code << "\t}\n\n";
+	}
+
+	cout << "/*\n *\tApollo Guidance Computer - Emulator\n *\n"
+		 << " *  Generated by agc-translate, do not edit.\n */\n\n"
+		 << "#include \"agc.h\"\n\n"
+		 << "struct aotBlocks {\n\n" << code.str() << "};\n\n"
+		 << "static const aotEntry table[] = {\n";
+	for(size_t i = 0; i < blocks.size(); i++){
+		cout << "\t{ " << blocks[i].first << ", " << (blocks[i].second ? "true" : "false")
+			 << ", aotBlocks::b" << blocks[i].first << (blocks[i].second ? "x" : "") << " },\n";
+	}
+	cout << "};\n\n"
+		 << "int aotBlocksRegistered = aotRegister(table, " << blocks.size() << ", " << m.romChecksum() << "u);\n";
+
+	cerr << blocks.size() << " blocks translated." << endl;
+
+	return 0;
+
+}
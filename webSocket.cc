@@ -0,0 +1,140 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#include "webSocket.h"
+
+using namespace std;
+
+static uint32_t rotate(uint32_t x, int n){
+	return (x << n) | (x >> (32 - n));
+}
+
+string sha1(const string &data){
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+	//Padding: 0x80, zeros up to 56 mod 64, length in bits big endian
+	string message = data + '\x80';
+	while(message.size() % 64 != 56)
+		message += '\0';
+	uint64_t bits = (uint64_t)data.size() * 8;
+	for(int i=7; i>=0; i--)
+		message += (char)(bits >> (i * 8));
+
+	for(size_t chunk=0; chunk<message.size(); chunk+=64){
+		uint32_t w[80];
+		for(int i=0; i<16; i++){
+			const unsigned char *p = (const unsigned char*)&message[chunk + i * 4];
+			w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+		}
+		for(int i=16; i<80; i++)
+			w[i] = rotate(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for(int i=0; i<80; i++){
+			uint32_t f, k;
+			if(i < 20){
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			}
+			else if(i < 40){
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if(i < 60){
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			uint32_t t = rotate(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rotate(b, 30);
+			b = a;
+			a = t;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+	}
+
+	string digest;
+	for(int i=0; i<5; i++)
+		for(int j=3; j>=0; j--)
+			digest += (char)(h[i] >> (j * 8));
+	return digest;
+}
+
+string base64(const string &data){
+	static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	string encoded;
+	for(size_t i=0; i<data.size(); i+=3){
+		uint32_t n = (unsigned char)data[i] << 16;
+		if(i + 1 < data.size())
+			n |= (unsigned char)data[i + 1] << 8;
+		if(i + 2 < data.size())
+			n |= (unsigned char)data[i + 2];
+		encoded += table[(n >> 18) & 63];
+		encoded += table[(n >> 12) & 63];
+		encoded += (i + 1 < data.size()) ? table[(n >> 6) & 63] : '=';
+		encoded += (i + 2 < data.size()) ? table[n & 63] : '=';
+	}
+	return encoded;
+}
+
+string wsAccept(const string &key){
+	return base64(sha1(key + WS_GUID));
+}
+
+string wsFrame(uint8_t opcode, const string &payload){
+	string frame;
+	frame += (char)(0x80 | opcode);//FIN
+	if(payload.size() < 126)
+		frame += (char)payload.size();
+	else if(payload.size() < 65536){
+		frame += (char)126;
+		frame += (char)(payload.size() >> 8);
+		frame += (char)payload.size();
+	}
+	else{
+		frame += (char)127;
+		for(int i=7; i>=0; i--)
+			frame += (char)((uint64_t)payload.size() >> (i * 8));
+	}
+	return frame + payload;
+}
+
+long wsParse(const char *buffer, size_t length, uint8_t &opcode, string &payload){
+	const unsigned char *p = (const unsigned char*)buffer;
+	if(length < 2)
+		return 0;
+
+	//Fragments, reserved bits and unmasked frames are not expected from a browser
+	if((p[0] & 0xF0) != 0x80 || (p[1] & 0x80) == 0)
+		return -1;
+	opcode = p[0] & 0x0F;
+
+	size_t size = p[1] & 0x7F;
+	size_t header = 2;
+	if(size == 126){
+		if(length < 4)
+			return 0;
+		size = (p[2] << 8) | p[3];
+		header = 4;
+	}
+	else if(size == 127)
+		return -1;
+	if(size > WS_MAX_MESSAGE)
+		return -1;
+
+	if(length < header + 4 + size)
+		return 0;
+	const unsigned char *mask = p + header;
+	payload.resize(size);
+	for(size_t i=0; i<size; i++)
+		payload[i] = p[header + 4 + i] ^ mask[i % 4];
+	return header + 4 + size;
+}
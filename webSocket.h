@@ -0,0 +1,33 @@
+/*
+ *	Apollo Guidance Computer - Emulator
+ *
+ *  Authors: Alexander DeRoberto, Antonio Di Tecco
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+/*
+ *	The few pieces of RFC 6455 the DSKY needs: the handshake key, the frames
+ *	the server sends (unmasked, never fragmented) and the frames clients send
+ *	(always masked). Messages are short text: JSON out, key characters in.
+ */
+
+#define WS_GUID		"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_TEXT		0x1
+#define WS_CLOSE	0x8
+#define WS_PING		0x9
+#define WS_PONG		0xA
+#define WS_MAX_MESSAGE	4096	// longest message taken from a client
+
+string sha1(const string &data);				/* 20 bytes digest */
+string base64(const string &data);
+string wsAccept(const string &key);				/* Sec-WebSocket-Accept for Sec-WebSocket-Key */
+string wsFrame(uint8_t opcode, const string &payload);
+
+/* one client frame at the start of buffer: bytes taken, 0 if it is not all there yet, -1 if it is not valid */
+long wsParse(const char *buffer, size_t length, uint8_t &opcode, string &payload);